@@ -19,7 +19,33 @@
 #if !defined(__NORI_BVH_H)
 #define __NORI_BVH_H
 
-#include <nori/mesh.h>
+#include <nori/packet.h>
+#include <nori/trianglepack.h>
+#include <Eigen/StdVector>
+#include <Eigen/Geometry>
+
+/* Branching factor of the optional wide BVH. Unless set explicitly (see the
+   NORI_BVH_WIDTH option in CMakeLists.txt), it follows the SIMD width of
+   the instruction set selected by the NORI_SIMD option */
+#if !defined(NORI_BVH_WIDTH)
+#  if defined(NORI_SIMD_AVX2) || defined(NORI_SIMD_AVX512)
+#    define NORI_BVH_WIDTH 8
+#  else
+#    define NORI_BVH_WIDTH 4
+#  endif
+#endif
+
+#if NORI_BVH_WIDTH < 2 || NORI_BVH_WIDTH > 16
+#  error "NORI_BVH_WIDTH must be between 2 and 16"
+#endif
+
+/* Dequantize the nodes of a quantized BVH4 or BVH8 using SSE2 */
+#if (NORI_BVH_WIDTH == 4 || NORI_BVH_WIDTH == 8) && (defined(__SSE2__) || defined(_M_X64))
+#  define NORI_BVH_SSE2 1
+#  include <emmintrin.h>
+#else
+#  define NORI_BVH_SSE2 0
+#endif
 
 NORI_NAMESPACE_BEGIN
 
@@ -42,9 +68,59 @@ NORI_NAMESPACE_BEGIN
  */
 class Accel {
     friend class BVHBuildTask;
+    friend class SBVHBuilder;
 public:
-    /// Create a new and empty BVH
-    Accel() { m_meshOffset.push_back(0u); }
+    /**
+     * \brief Create a new and empty BVH
+     *
+     * The following (optional) properties are supported:
+     *
+     * <tt>wideBVH</tt>: collapse the binary tree into a BVH with
+     * \ref NORI_BVH_WIDTH children per node after construction
+     * (default: \c false)
+     *
+     * <tt>quantizedBVH</tt>: store the nodes of the wide BVH in compressed
+     * form (see \ref QuantizedWideBVHNode), which halves their size and
+     * thus the memory traffic during traversal. Implies \c wideBVH
+     * (default: \c false)
+     *
+     * <tt>orderedTraversal</tt>: visit the children of binary nodes from
+     * front to back, using the ray direction along the split axis, and
+     * skip subtrees lying behind the closest intersection found so far
+     * (default: \c true)
+     *
+     * <tt>bvhPreset</tt>: trade-off between build time and tree quality.
+     * All presets evaluate the SAH over binned centroids along all three
+     * axes, using 8 (\c fast), 32 (\c balanced), or 64 (\c high-quality)
+     * bins. The \c high-quality preset additionally evaluates every
+     * possible split (full sweep) near the leaves (default: \c balanced)
+     *
+     * <tt>spatialSplits</tt>: build a spatial split BVH (SBVH), which may
+     * clip triangles and reference them from several leaves. This greatly
+     * improves trees for scenes with long or large, overlapping triangles,
+     * but the build is serial and slower (default: \c false)
+     *
+     * <tt>spatialSplitBudget</tt>: maximum number of duplicate references
+     * created by spatial splits, relative to the number of triangles
+     * (default: 0.5)
+     *
+     * <tt>bvhCache</tt>: name of a file that caches the BVH between runs
+     * (relative to the scene directory). The cache is keyed by a hash of
+     * the mesh geometry and the build parameters and is rewritten when
+     * either of them changes. Corrupted cache files are detected (using
+     * a checksum and a validation of the tree) and rebuilt (default: none)
+     *
+     * <tt>rebuildThreshold</tt>: \ref refit() rebuilds the tree when its
+     * SAH cost exceeds the cost after the last build by this factor. A
+     * value of zero disables rebuilds (default: 1.5)
+     *
+     * <tt>precomputeTriangles</tt>: store a copy of every referenced
+     * triangle in leaf order (see \ref PrecomputedTriangle), which speeds
+     * up the leaf intersection tests but takes 28-64 bytes per reference.
+     * When disabled, the leaves intersect the triangles of the meshes
+     * directly (default: \c true, unless a mesh is compressed or memory-mapped)
+     */
+    Accel(const PropertyList &propList = PropertyList());
 
     /// Release all resources
     virtual ~Accel() { clear(); };
@@ -59,9 +135,57 @@ public:
      */
     void addMesh(Mesh *mesh);
 
-    /// Build the BVH
+    /**
+     * \brief Register an instance of a mesh for inclusion in the BVH.
+     *
+     * Meshes referenced by instances are removed from the BVH over the
+     * remaining triangles when \ref build() is called. Each of them
+     * instead receives a separate BVH, which is shared by all of its
+     * instances and traversed in object space. A top-level BVH over the
+     * world-space bounds of the instances determines which of them a ray
+     * has to visit.
+     *
+     * This function can only be used before \ref build() is called
+     */
+    void addInstance(const Instance *instance);
+
+    /**
+     * \brief Build the BVH
+     *
+     * Moving meshes (see \ref Mesh::hasMotion()) are placed in a separate
+     * motion BVH, whose nodes store bounds at both ends of the shutter
+     * interval. Rays test these bounds interpolated to their time, which
+     * keeps the tree tight for fast-moving geometry, while the static
+     * triangles retain the faster traversal code (including the wide
+     * BVH and spatial splits, which the motion BVH does not use).
+     *
+     * Loads the tree from the cache file instead (see \c bvhCache) if
+     * one exists for the current meshes and build parameters
+     */
     void build();
 
+    /**
+     * \brief Update the BVH after the vertex positions of the registered
+     * meshes have changed (see \ref Mesh::setVertexPositions())
+     *
+     * Recomputes the bounds of all nodes from the bottom up while keeping
+     * the tree topology, which is much faster than a full build. Since the
+     * tree quality degrades as the triangles move, the tree is rebuilt
+     * instead when its SAH cost exceeds the limit set by the
+     * \c rebuildThreshold property. The top-level BVH over instances is
+     * always rebuilt, which also picks up changed vertex positions of
+     * instanced meshes.
+     *
+     * \return \c true if any tree was rebuilt
+     */
+    bool refit();
+
+    /**
+     * \brief Update the top-level BVH after the transformations of
+     * instances have changed (e.g. when moving to another animation frame)
+     */
+    void updateInstances();
+
     /**
      * \brief Intersect a ray against all triangle meshes registered
      * with the BVH
@@ -80,9 +204,54 @@ public:
     bool rayIntersect(const Ray3f &ray, Intersection &its, 
         bool shadowRay = false) const;
 
+    /**
+     * \brief Intersect a packet of coherent rays against all triangle
+     * meshes registered with the BVH
+     *
+     * The rays are traversed together, and each BVH node is tested against
+     * all active rays of the packet using one SIMD slab test. This is
+     * considerably faster than tracing the rays one by one when they
+     * visit similar parts of the tree (e.g. camera rays of an image block,
+     * see \ref Integrator::usesPrimaryPackets()). The wide, quantized,
+     * and ordered traversal modes are supported as well.
+     *
+     * Instantiated for packets of 4, 8, and 16 rays.
+     *
+     * \return \c true If at least one of the rays found an intersection
+     */
+    template <int Size> bool rayIntersect(const TRayPacket<Size> &packet,
+        TIntersectionPacket<Size> &its) const;
+
+    /**
+     * \brief Check whether a ray segment intersects any triangle mesh
+     * registered with the BVH
+     *
+     * This any-hit query uses its own traversal order: children with a
+     * larger surface area (which are more likely to contain an occluder)
+     * are visited first, and the search ends with the first intersection.
+     * This is the function to use for shadow rays.
+     *
+     * \return \c true If the ray segment is occluded
+     */
+    bool occluded(const Ray3f &ray) const;
+
+    /**
+     * \brief Check a packet of shadow rays for occlusion
+     *
+     * Lanes drop out of the traversal as soon as they are found to be
+     * occluded. Instantiated for packets of 4, 8, and 16 rays.
+     *
+     * \return A mask of the active lanes whose ray segment is occluded
+     */
+    template <int Size> typename TRayPacket<Size>::MaskPacket
+        occluded(const TRayPacket<Size> &packet) const;
+
     /// Return the total number of meshes registered with the BVH
     uint32_t getMeshCount() const { return (uint32_t) m_meshes.size(); }
 
+    /// Return the total number of registered instances
+    uint32_t getInstanceCount() const { return (uint32_t) m_instances.size(); }
+
     /// Return the total number of internally represented triangles 
     uint32_t getTriangleCount() const { return m_meshOffset.back(); }
 
@@ -120,6 +289,187 @@ protected:
         return m_meshes[meshIdx]->getCentroid(index);
     }
 
+    /**
+     * \brief Fill in the detailed intersection record for a hit
+     * with triangle \c f of \c its.mesh at the given time
+     *
+     * Expects \c its.t, \c its.uv (barycentric coordinates), and
+     * \c its.mesh to be set by the traversal code
+     */
+    void fillIntersection(uint32_t f, Intersection &its, float time = 0.f) const;
+
+    /**
+     * \brief Precompute the triangle data used by the leaf intersection
+     * code (called by \ref build())
+     *
+     * Fills \ref m_packs when a vectorized kernel is available, and
+     * \ref m_triangles otherwise. Does nothing when the precomputation
+     * is disabled (see the <tt>precomputeTriangles</tt> property).
+     */
+    void precomputeTriangles();
+
+    /**
+     * \brief Intersect a ray against the triangles of a leaf node
+     *
+     * Updates <tt>ray.maxt</tt> when a closer intersection is found
+     * and returns its barycentric coordinates, mesh, and triangle index.
+     * When \c shadowRay is set, the function returns on the first hit.
+     */
+    bool intersectLeaf(uint32_t node_idx, Ray3f &ray, float &u, float &v,
+        uint32_t &mesh, uint32_t &f, bool shadowRay) const;
+
+    /// Collapse the binary BVH into a wide BVH (called by \ref build())
+    void collapse();
+
+    /// Recursively collapse the subtree below a binary inner node
+    uint32_t collapse(uint32_t node_idx);
+
+    /// Convert the wide BVH into quantized nodes (called by \ref collapse())
+    void quantize();
+
+    /**
+     * \brief Build the per-mesh BVHs and the top-level BVH over all
+     * instances (called by \ref build())
+     */
+    void buildInstances();
+
+    /// Build the top-level BVH over all instances
+    void buildTopLevel();
+
+    /// Recursively build the top-level BVH over the given instances
+    void buildInstanceTree(const BoundingBox3f *bounds, uint32_t *start, uint32_t *end);
+
+    /// Closest-hit query against the static triangles that are not instanced
+    bool rayIntersectTriangles(const Ray3f &ray, Intersection &its) const;
+
+    /**
+     * \brief Move the meshes with motion into the separate motion BVH
+     * and build it (called by \ref build())
+     */
+    void buildMotion();
+
+    /**
+     * \brief Split the node bounds of a motion BVH into bounds at the
+     * start (\ref m_nodes) and end (\ref m_nodeBoundsEnd) of the
+     * shutter interval
+     *
+     * The tree itself is built over the bounds of the triangles over the
+     * whole shutter interval.
+     */
+    void updateMotionBounds();
+
+    /// Return the bounds of a motion BVH node at the given time
+    BoundingBox3f getMotionBounds(uint32_t node_idx, float time) const {
+        const BoundingBox3f &start = m_nodes[node_idx].bbox,
+                            &end = m_nodeBoundsEnd[node_idx];
+        return BoundingBox3f((1 - time) * start.min + time * end.min,
+                             (1 - time) * start.max + time * end.max);
+    }
+
+    /// Intersect a ray against the triangles of a motion BVH leaf at the ray's time
+    bool intersectLeafMotion(uint32_t node_idx, Ray3f &ray, float &u, float &v,
+        uint32_t &mesh, uint32_t &f, bool shadowRay) const;
+
+    /**
+     * \brief Closest-hit query against a motion BVH
+     *
+     * Only considers intersections closer than \c its.t
+     */
+    bool rayIntersectMotion(const Ray3f &ray, Intersection &its) const;
+
+    /// Occlusion query against a motion BVH
+    bool occludedMotion(const Ray3f &ray) const;
+
+    /// Recompute \ref m_bbox from the meshes, instances, and the motion BVH
+    void updateBoundingBox();
+
+    /**
+     * \brief Closest-hit query against all instances
+     *
+     * Only considers intersections closer than \c its.t and overwrites
+     * \c its with a world-space intersection record upon success
+     */
+    bool rayIntersectInstances(const Ray3f &ray, Intersection &its) const;
+
+    /**
+     * \brief Closest-hit query against all instances and moving meshes,
+     * which are handled one ray of a packet at a time
+     */
+    template <int Size> bool rayIntersectLanes(
+        const TRayPacket<Size> &packet, TIntersectionPacket<Size> &its) const;
+
+    /// Occlusion query against all instances
+    bool occludedInstances(const Ray3f &ray) const;
+
+    /// Front-to-back traversal of the binary BVH (see \c orderedTraversal)
+    bool rayIntersectOrdered(const Ray3f &ray, Intersection &its,
+        bool shadowRay) const;
+
+    /**
+     * \brief Traversal code used when a wide BVH is available
+     *
+     * Instantiated for \ref WideBVHNode and \ref QuantizedWideBVHNode
+     */
+    template <typename Node> bool rayIntersectWide(const Node *nodes,
+        const Ray3f &ray, Intersection &its, bool shadowRay) const;
+
+    /// Occlusion query used when a wide BVH is available
+    template <typename Node> bool occludedWide(const Node *nodes,
+        const Ray3f &ray) const;
+
+    /**
+     * \brief Packet traversal of the binary BVH
+     *
+     * Records the closest hit of every lane in \c its (except for the
+     * fields computed by \ref fillIntersection()) and its triangle in
+     * \c f. The rays in \c rays are the lanes of \c packet, whose
+     * segments are shortened as intersections are found.
+     */
+    template <int Size> void rayIntersectPacket(TRayPacket<Size> &packet,
+        Ray3f *rays, uint32_t *f, TIntersectionPacket<Size> &its) const;
+
+    /// Packet traversal used when a wide BVH is available (see \ref rayIntersectPacket())
+    template <typename Node, int Size> void rayIntersectWide(const Node *nodes,
+        TRayPacket<Size> &packet, Ray3f *rays, uint32_t *f,
+        TIntersectionPacket<Size> &its) const;
+
+    /**
+     * \brief Packet occlusion query used when a wide BVH is available
+     *
+     * Occluded lanes are flagged in \c result and disabled in \c packet
+     */
+    template <typename Node, int Size> void occludedWide(const Node *nodes,
+        TRayPacket<Size> &packet, Ray3f *rays,
+        typename TRayPacket<Size>::MaskPacket &result) const;
+
+    /**
+     * \brief Construct \ref m_nodes and \ref m_indices (called by \ref build())
+     *
+     * \return Internal tree statistics (see \ref statistics())
+     */
+    std::pair<float, uint32_t> buildTree();
+
+    /// Decide which child occlusion queries visit first (see \ref BVHNode)
+    void updateOcclusionOrder();
+
+    /// Version of the BVH cache file format (increase when changing \ref BVHNode)
+    static const uint32_t CacheVersion = 2;
+
+    /// Hash the meshes and build parameters to identify a cached BVH
+    uint64_t getCacheKey() const;
+
+    /// Try to load \ref m_nodes and \ref m_indices from the cache file
+    bool readCache(uint64_t key);
+
+    /**
+     * \brief Check that \ref m_nodes and \ref m_indices form a tree that
+     * the traversal code can safely process (used for cached BVHs)
+     */
+    bool isValidTree() const;
+
+    /// Write \ref m_nodes and \ref m_indices to the cache file
+    void writeCache(uint64_t key) const;
+
     /// Compute internal tree statistics
     std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
 
@@ -134,7 +484,9 @@ protected:
 
             struct {
                 unsigned flag : 1;
-                uint32_t axis : 31;
+                uint32_t axis : 2;
+                uint32_t rightFirst : 1; /* Visit the right child first in occlusion queries */
+                uint32_t unused : 28;
                 uint32_t rightChild;
             } inner;
 
@@ -162,11 +514,254 @@ protected:
             return leaf.start + leaf.size;
         }
     };
+
+    /**
+     * \brief Wide BVH node storing the bounds of all children in
+     * structure-of-arrays layout
+     *
+     * This makes it possible to test a ray against all children using
+     * one SIMD slab test. Children are stored contiguously and sorted by
+     * decreasing surface area (see \ref occluded()); unused slots follow
+     * the used ones. A child is either another wide node or a leaf of
+     * the binary tree (marked by \c LeafFlag), whose triangle range is
+     * looked up in \ref m_nodes.
+     */
+    struct WideBVHNode {
+        enum {
+            Width = NORI_BVH_WIDTH
+        };
+
+        static const uint32_t LeafFlag = 0x80000000u;
+
+        typedef Eigen::Array<float, Width, 1> FloatPacket;
+
+        FloatPacket min[3];     ///< Minimum child bounds (per dimension)
+        FloatPacket max[3];     ///< Maximum child bounds (per dimension)
+        uint32_t child[Width];  ///< Child references
+        uint32_t count;         ///< Number of used child slots
+
+        bool isLeaf(int i) const {
+            return (child[i] & LeafFlag) != 0;
+        }
+
+        uint32_t index(int i) const {
+            return child[i] & ~LeafFlag;
+        }
+
+        /// Return the bounds of the child in slot \c i
+        BoundingBox3f getBounds(int i) const {
+            return BoundingBox3f(Point3f(min[0][i], min[1][i], min[2][i]),
+                                 Point3f(max[0][i], max[1][i], max[2][i]));
+        }
+
+        /**
+         * \brief Intersect a ray segment against the bounds of all children
+         *
+         * \param o
+         *    Ray origin
+         * \param dRcp
+         *    Reciprocal ray direction (finite for axis-parallel rays)
+         * \param nearT
+         *    Must contain the start of the ray segment and returns the
+         *    entry distances
+         * \param farT
+         *    Must contain the end of the ray segment and returns the
+         *    exit distances (children are hit if <tt>nearT <= farT</tt>)
+         */
+        void rayIntersect(const Point3f &o, const float *dRcp,
+                          FloatPacket &nearT, FloatPacket &farT) const {
+            for (int i=0; i<3; ++i) {
+                FloatPacket t1 = (min[i] - o[i]) * dRcp[i];
+                FloatPacket t2 = (max[i] - o[i]) * dRcp[i];
+                nearT = nearT.max(t1.min(t2));
+                farT  = farT.min(t1.max(t2));
+            }
+        }
+    };
+
+    typedef std::vector<WideBVHNode, Eigen::aligned_allocator<WideBVHNode>> WideNodeVector;
+
+    /**
+     * \brief Compressed version of \ref WideBVHNode
+     *
+     * Child bounds are stored using 8 bits per coordinate on a grid that
+     * spans the bounds of the node, with a power-of-two spacing per axis.
+     * The quantized bounds are rounded outward, hence they always contain
+     * the original bounds and the traversal visits the same leaves (plus
+     * occasionally a few more). Nodes are less than half the size of a
+     * \ref WideBVHNode (one cache line for <tt>NORI_BVH_WIDTH=4</tt>).
+     */
+    struct alignas(64) QuantizedWideBVHNode {
+        enum {
+            Width = NORI_BVH_WIDTH
+        };
+
+        typedef WideBVHNode::FloatPacket FloatPacket;
+        typedef Eigen::Array<uint8_t, Width, 1> BytePacket;
+
+        float origin[3];         ///< Minimum corner of the node bounds
+        int8_t exponent[3];      ///< Grid spacing (base-2 logarithm, per dimension)
+        uint8_t count;           ///< Number of used child slots
+        BytePacket qmin[3];      ///< Quantized minimum child bounds (per dimension)
+        BytePacket qmax[3];      ///< Quantized maximum child bounds (per dimension)
+        uint32_t child[Width];   ///< Child references (see \ref WideBVHNode)
+
+        bool isLeaf(int i) const {
+            return (child[i] & WideBVHNode::LeafFlag) != 0;
+        }
+
+        uint32_t index(int i) const {
+            return child[i] & ~WideBVHNode::LeafFlag;
+        }
+
+        /// Return the grid spacing along the given dimension
+        float getScale(int k) const {
+            uint32_t bits = (uint32_t) (exponent[k] + 127) << 23;
+            float scale;
+            memcpy(&scale, &bits, sizeof(float));
+            return scale;
+        }
+
+        /// Return the (dequantized) bounds of the child in slot \c i
+        BoundingBox3f getBounds(int i) const {
+            BoundingBox3f bbox;
+            for (int k=0; k<3; ++k) {
+                float scale = getScale(k);
+                bbox.min[k] = (float) qmin[k][i] * scale + origin[k];
+                bbox.max[k] = (float) qmax[k][i] * scale + origin[k];
+            }
+            return bbox;
+        }
+
+        /**
+         * \brief Intersect a ray segment against the bounds of all children
+         * (see \ref WideBVHNode::rayIntersect())
+         *
+         * The bounds are dequantized on the fly. They contain the original
+         * bounds (see \ref Accel::quantize()), hence the test never misses
+         * a child that the original wide node would have reported.
+         */
+        void rayIntersect(const Point3f &o, const float *dRcp,
+                          FloatPacket &nearT, FloatPacket &farT) const {
+            for (int i=0; i<3; ++i) {
+                float scale = getScale(i);
+                FloatPacket t1 = (toFloat(qmin[i]) * scale + origin[i] - o[i]) * dRcp[i];
+                FloatPacket t2 = (toFloat(qmax[i]) * scale + origin[i] - o[i]) * dRcp[i];
+                nearT = nearT.max(t1.min(t2));
+                farT  = farT.min(t1.max(t2));
+            }
+        }
+
+        /// Convert the quantized coordinates of all children into floats
+        static FloatPacket toFloat(const BytePacket &value) {
+#if NORI_BVH_SSE2
+            /* Eigen converts the bytes one at a time */
+            __m128i zero = _mm_setzero_si128(), v;
+            if (Width == 4) {
+                int32_t bytes;
+                memcpy(&bytes, value.data(), sizeof(int32_t));
+                v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+            } else {
+                v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) value.data()), zero);
+            }
+            FloatPacket result;
+            _mm_storeu_ps(result.data(), _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+            if (Width == 8)
+                _mm_storeu_ps(result.data() + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+            return result;
+#else
+            return value.template cast<float>();
+#endif
+        }
+    };
+
+    /**
+     * \brief Precomputed triangle used by the leaf intersection code
+     *
+     * The BVH stores one of these records per triangle reference, in
+     * the same order as \ref m_indices. A leaf can therefore intersect
+     * its triangles by streaming over contiguous memory, without
+     * looking up the mesh (\ref findMesh()) or gathering vertices
+     * through the index buffer. Each record occupies one cache line.
+     */
+    struct alignas(64) PrecomputedTriangle {
+        Point3f p0;     ///< First vertex
+        Vector3f e1;    ///< Edge from the first to the second vertex
+        Vector3f e2;    ///< Edge from the first to the third vertex
+        uint32_t mesh;  ///< Index of the mesh in \ref m_meshes
+        uint32_t index; ///< Index of the triangle within the mesh
+
+        /**
+         * \brief Ray-triangle intersection test
+         *
+         * Same algorithm (and results) as \ref Mesh::rayIntersect()
+         */
+        bool rayIntersect(const Ray3f &ray, float &u, float &v, float &t) const {
+            /* Begin calculating determinant - also used to calculate U parameter */
+            Vector3f pvec = ray.d.cross(e2);
+
+            /* If determinant is near zero, ray lies in plane of triangle */
+            float det = e1.dot(pvec);
+
+            if (det > -1e-8f && det < 1e-8f)
+                return false;
+            float inv_det = 1.0f / det;
+
+            /* Calculate distance from v[0] to ray origin */
+            Vector3f tvec = ray.o - p0;
+
+            /* Calculate U parameter and test bounds */
+            u = tvec.dot(pvec) * inv_det;
+            if (u < 0.0 || u > 1.0)
+                return false;
+
+            /* Prepare to test V parameter */
+            Vector3f qvec = tvec.cross(e1);
+
+            /* Calculate V parameter and test bounds */
+            v = ray.d.dot(qvec) * inv_det;
+            if (v < 0.0 || u + v > 1.0)
+                return false;
+
+            /* Ray intersects triangle -> compute t */
+            t = e2.dot(qvec) * inv_det;
+
+            return t >= ray.mint && t <= ray.maxt;
+        }
+    };
+
 private:
     std::vector<Mesh *> m_meshes;       ///< List of meshes registered with the BVH
     std::vector<uint32_t> m_meshOffset; ///< Index of the first triangle for each shape
     std::vector<BVHNode> m_nodes;       ///< BVH nodes
     std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
+    std::vector<PrecomputedTriangle> m_triangles; ///< Leaf-ordered triangle data
+    std::vector<TrianglePack> m_packs;  ///< Leaf-ordered triangle packs (SIMD kernel)
+    std::vector<uint32_t> m_packOffset; ///< Index of the first pack of each leaf node
+    TrianglePackIntersector m_packIntersect = nullptr; ///< Vectorized leaf kernel
+    bool m_precompute = true;           ///< Precompute the triangles of the leaves?
+    bool m_precomputeDefault = true;    ///< Was \ref m_precompute left at its default?
+    WideNodeVector m_wideNodes;         ///< Collapsed wide BVH (optional)
+    std::vector<QuantizedWideBVHNode> m_quantNodes; ///< Quantized wide BVH (optional)
+    bool m_wide = false;                ///< Build a wide BVH?
+    bool m_quantized = false;           ///< Quantize the nodes of the wide BVH?
+    bool m_ordered = true;              ///< Front-to-back traversal of the binary BVH?
+    int m_binCount = 32;                ///< Number of SAH bins per axis
+    bool m_fullSweep = false;           ///< Full-sweep SAH near the leaves?
+    bool m_spatialSplits = false;       ///< Build a spatial split BVH?
+    float m_spatialSplitBudget = 0.5f;  ///< Relative number of duplicate references
+    std::string m_cacheFilename;        ///< BVH cache file (optional)
+    float m_rebuildThreshold = 1.5f;    ///< Relative SAH cost increase that triggers a rebuild
+    float m_sahCost = 0.f;              ///< SAH cost after the last build
+    PropertyList m_propList;            ///< Parameters of the per-mesh BVHs
+    std::vector<const Instance *> m_instances;     ///< Registered instances
+    std::vector<const Accel *> m_instanceAccels;   ///< BVH of the mesh of each instance
+    std::vector<Accel *> m_meshAccels;             ///< Per-mesh BVHs (shared by instances)
+    std::vector<BVHNode> m_instanceNodes;          ///< Top-level BVH nodes
+    std::vector<uint32_t> m_instanceIndices;       ///< Instance indices referenced by leaves
+    Accel *m_motionAccel = nullptr;     ///< BVH over the moving meshes (optional)
+    bool m_motion = false;              ///< Is this a motion BVH?
+    std::vector<BoundingBox3f> m_nodeBoundsEnd; ///< Node bounds at the end of the shutter interval
     BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
 };
 
@@ -0,0 +1,85 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/sampler.h>
+
+/**
+ * Luminance below which the error of a pixel is measured relative to this
+ * value instead of the pixel's mean (so that nearly black but noisy pixels
+ * don't use up the sample budget)
+ */
+#define NORI_ADAPTIVE_MIN_LUMINANCE 1e-2f
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Distributes the samples of adaptive rendering passes
+ *
+ * Adaptive sampling starts with a few uniform passes over the image,
+ * which record the mean and variance of every pixel's samples (see
+ * \ref ImageBlock::enableStatistics()). Based on these, the allocator
+ * estimates the relative error of every pixel, i.e. the standard error
+ * of its mean divided by the mean, and assigns the samples of the next
+ * pass to the pixels whose error is above the target.
+ *
+ * A pixel receives the number of samples that is expected to bring its
+ * error down to the target, but at most as many as it already has, since
+ * the variance estimates of pixels with few samples are unreliable. For
+ * the same reason, the error of a pixel is taken to be the maximum over
+ * its 3x3 neighborhood, so that a single lucky pixel (e.g. one whose
+ * samples all missed a small light source) is not considered converged.
+ * When the requested samples exceed the budget of the pass, they are
+ * scaled down evenly.
+ *
+ * Neighboring pixels therefore end up with very different numbers of
+ * samples. A reconstruction filter that spans several pixels would
+ * normalize by the summed filter weights of all samples in its support,
+ * so the pixels with many samples would dominate their neighbors and bias
+ * the edges between converged and still active regions. Adaptive renders
+ * hence reconstruct every pixel from its own samples (i.e. with a box
+ * filter) instead of the camera's filter, trading some anti-aliasing
+ * quality for an unbiased estimate of each pixel.
+ */
+class SampleAllocator {
+public:
+    /**
+     * \brief Create a sample allocator
+     * \param size
+     *     Size of the image
+     * \param errorTarget
+     *     Relative error below which a pixel is considered converged
+     */
+    SampleAllocator(const Vector2i &size, float errorTarget);
+
+    /**
+     * \brief Plan the next pass
+     *
+     * \param image
+     *     The image rendered so far (with sample statistics)
+     * \param budget
+     *     Maximum number of samples that may be assigned
+     * \return
+     *     The number of assigned samples (zero if all pixels converged)
+     */
+    size_t plan(const ImageBlock &image, size_t budget);
+
+    /// Return the number of samples per pixel assigned by \ref plan()
+    const SampleMap &getSampleMap() const { return m_sampleMap; }
+
+    /// Return the number of pixels whose error was above the target in \ref plan()
+    size_t getActivePixels() const { return m_activePixels; }
+private:
+    typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> FloatMap;
+
+    float m_errorTarget;
+    SampleMap m_sampleMap;
+    FloatMap m_error, m_scratch;
+    size_t m_activePixels = 0;
+};
+
+NORI_NAMESPACE_END
@@ -13,11 +13,52 @@
 #include <nori/color.h>
 #include <nori/vector.h>
 #include <tbb/mutex.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
+#define NORI_BLOCK_STRIPE 8 /* Number of rows protected by each lock of a block */
+#define NORI_BLOCK_SPLIT_COUNT 16 /* Number of blocks split at the end of a frame */
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Running mean and variance of the luminance of a pixel's samples
+ *
+ * The statistics are updated with the numerically robust online estimator
+ * by Welford (the same one that is used by the t-test in ttest.cpp). Two
+ * sets of statistics can be combined, which is needed when image blocks
+ * are merged.
+ */
+struct PixelStatistics {
+    float count = 0; ///< Number of samples
+    float mean = 0;  ///< Mean luminance of the samples
+    float m2 = 0;    ///< Sum of the squared deviations from the mean
+
+    /// Record the luminance of a sample
+    void put(float value) {
+        count += 1;
+        float delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+
+    /// Merge the statistics of another set of samples (Chan et al.)
+    void put(const PixelStatistics &stats) {
+        if (stats.count == 0)
+            return;
+        float total = count + stats.count, delta = stats.mean - mean;
+        mean += delta * stats.count / total;
+        m2 += stats.m2 + delta * delta * count * stats.count / total;
+        count = total;
+    }
+
+    /// Return the (unbiased) sample variance
+    float getVariance() const { return count > 1 ? m2 / (count - 1) : 0.0f; }
+};
+
 /**
  * \brief Weighted pixel storage for a rectangular subregion of an image
  *
@@ -44,9 +85,6 @@ public:
      */
     ImageBlock(const Vector2i &size, const ReconstructionFilter *filter);
     
-    /// Release all memory
-    ~ImageBlock();
-    
     /// Configure the offset of the block within the main image
     void setOffset(const Point2i &offset) { m_offset = offset; }
 
@@ -73,25 +111,77 @@ public:
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
-    /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    /// Clear all contents (including the sample statistics)
+    void clear() {
+        setConstant(Color4f());
+        std::fill(m_stats.begin(), m_stats.end(), PixelStatistics());
+    }
+
+    /**
+     * \brief Keep statistics of the samples of every pixel in a second buffer
+     *
+     * Afterwards, the batched \ref put(const Point2f *, const Color3f *, size_t)
+     * records the luminance of each sample in the statistics of the pixel
+     * that contains it (irrespective of the reconstruction filter), and
+     * merging blocks also merges their statistics. This is used to estimate
+     * the error of each pixel during adaptive sampling.
+     */
+    void enableStatistics();
+
+    /// Are per-pixel sample statistics recorded?
+    bool hasStatistics() const { return !m_stats.empty(); }
 
-    /// Record a sample with the given position and radiance value
+    /// Return the sample statistics of a pixel (relative to the block's offset)
+    const PixelStatistics &getStatistics(int x, int y) const {
+        return m_stats[y * m_statsStride + x];
+    }
+
+    /**
+     * \brief Record a sample with the given position and radiance value
+     *
+     * This function does not use any scratch space of the block, so
+     * several threads may call it at the same time as long as they
+     * update disjoint pixels.
+     */
     void put(const Point2f &pos, const Color3f &value);
 
+    /**
+     * \brief Record a batch of samples
+     *
+     * Equivalent to calling \ref put(const Point2f &, const Color3f &)
+     * for each sample, but considerably faster when consecutive samples
+     * lie in the same pixel (e.g. all samples of a pixel). Such a run of
+     * samples is splatted at once: the separable filter weights of all
+     * samples are tabulated over a fixed footprint around the pixel, which
+     * is known to lie inside the block, and each pixel of the footprint is
+     * updated only once. Short runs, samples outside of the block and
+     * invalid values take the per-sample code path.
+     *
+     * The weight tables are kept in scratch space that is owned by the
+     * block and only grows, so a block that is reused for rendering stops
+     * allocating memory after the first few batches. For the same reason,
+     * only one thread at a time may call this function on a given block.
+     *
+     * If statistics are enabled (see \ref enableStatistics()), the samples
+     * that lie inside the block are also recorded there.
+     */
+    void put(const Point2f *pos, const Color3f *value, size_t count);
+
     /**
      * \brief Merge another image block into this one
      *
-     * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * The rows of the destination block are divided into stripes of
+     * \ref NORI_BLOCK_STRIPE rows, each of which is protected by its own
+     * mutex. The merge locks one stripe at a time, so threads that merge
+     * blocks from different parts of the image do not wait for each other.
      */
     void put(ImageBlock &b);
 
-    /// Lock the image block (using an internal mutex)
-    inline void lock() const { m_mutex.lock(); }
+    /// Lock the image block (i.e. all of its stripes)
+    void lock() const;
     
     /// Unlock the image block
-    inline void unlock() const { m_mutex.unlock(); }
+    void unlock() const;
 
     /// Return a human-readable string summary
     std::string toString() const;
@@ -99,12 +189,12 @@ protected:
     Point2i m_offset;
     Vector2i m_size;
     int m_borderSize = 0;
-    float *m_filter = nullptr;
-    float m_filterRadius = 0;
-    float *m_weightsX = nullptr;
-    float *m_weightsY = nullptr;
-    float m_lookupFactor = 0;
-    mutable tbb::mutex m_mutex;
+    const FilterTable *m_filter = nullptr;
+    std::vector<float> m_batchScratch;
+    std::vector<PixelStatistics> m_stats;
+    int m_statsStride = 0;
+    int m_stripeCount = 0;
+    std::unique_ptr<tbb::mutex[]> m_stripes;
 };
 
 /**
@@ -114,6 +204,9 @@ protected:
  * rectangular blocks suitable for parallel rendering. The blocks
  * are ordered in spiraling pattern so that the center is
  * rendered first.
+ *
+ * The order is computed once in the constructor. Afterwards, threads
+ * request blocks by incrementing an atomic counter, so no lock is needed.
  */
 class BlockGenerator {
 public:
@@ -123,32 +216,41 @@ public:
      *      Size of the image that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
+     * \param splitCount
+     *      Number of blocks at the end of the spiral that are split into
+     *      four quarter-size blocks. Handing out smaller blocks at the end
+     *      of a frame keeps all threads busy until the image is done.
+     *      Samplers seed their random numbers from the block offsets, so
+     *      this should not depend on the number of threads (which would
+     *      make the rendered image depend on it as well).
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
+    BlockGenerator(const Vector2i &size, int blockSize, int splitCount = 0);
     
     /**
      * \brief Return the next block to be rendered
      *
-     * This function is thread-safe
+     * This function is thread-safe and lock-free
      *
      * \return \c false if there were no more blocks
      */
     bool next(ImageBlock &block);
 
+    /// Start handing out the blocks again (e.g. for another pass over the image)
+    void reset() { m_next = 0; }
+
     /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
+    int getBlockCount() const { return (int) m_blocks.size(); }
 protected:
     enum EDirection { ERight = 0, EDown, ELeft, EUp };
 
-    Point2i m_block;
-    Vector2i m_numBlocks;
-    Vector2i m_size;
-    int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    /// Offset and size of a block
+    struct Block {
+        Point2i offset;
+        Vector2i size;
+    };
+
+    std::vector<Block> m_blocks;
+    std::atomic<int> m_next;
 };
 
 NORI_NAMESPACE_END
@@ -86,6 +86,39 @@ public:
 
     virtual float pdf(const BSDFQueryRecord &bRec) const = 0;
 
+    /**
+     * \brief Sample the BSDF for a batch of query records
+     *
+     * Equivalent to calling \ref sample() for each record. Renderers that
+     * group their hit points by BSDF (e.g. the wavefront path tracer) use
+     * the batched interface to shade a whole group with a single virtual
+     * call. BSDFs derived from \ref TBSDF provide devirtualized loops.
+     *
+     * \param count   Number of records
+     * \param bRec    Array of \c count BSDF query records
+     * \param sample  Array of \c count uniformly distributed samples
+     * \param result  Array that receives the importance weights
+     */
+    virtual void sampleBatch(size_t count, BSDFQueryRecord *bRec,
+            const Point2f *sample, Color3f *result) const {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = this->sample(bRec[i], sample[i]);
+    }
+
+    /// Evaluate the BSDF for a batch of query records (see \ref eval())
+    virtual void evalBatch(size_t count, const BSDFQueryRecord *bRec,
+            Color3f *result) const {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = eval(bRec[i]);
+    }
+
+    /// Compute the sampling density for a batch of query records (see \ref pdf())
+    virtual void pdfBatch(size_t count, const BSDFQueryRecord *bRec,
+            float *result) const {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = pdf(bRec[i]);
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
      * provided by this instance
@@ -100,4 +133,38 @@ public:
     virtual bool isDiffuse() const { return false; }
 };
 
+/**
+ * \brief Base class of BSDFs that implements the batched interface
+ *
+ * The batched methods call the \ref sample(), \ref eval() and \ref pdf()
+ * implementations of \c Derived directly instead of through the virtual
+ * function table. The compiler can then inline them into a tight loop,
+ * which keeps a single BSDF's code hot while a batch is shaded.
+ *
+ * \tparam Derived The concrete BSDF class (curiously recurring template)
+ */
+template <typename Derived> class TBSDF : public BSDF {
+public:
+    void sampleBatch(size_t count, BSDFQueryRecord *bRec,
+            const Point2f *sample, Color3f *result) const {
+        const Derived *bsdf = static_cast<const Derived *>(this);
+        for (size_t i = 0; i < count; ++i)
+            result[i] = bsdf->Derived::sample(bRec[i], sample[i]);
+    }
+
+    void evalBatch(size_t count, const BSDFQueryRecord *bRec,
+            Color3f *result) const {
+        const Derived *bsdf = static_cast<const Derived *>(this);
+        for (size_t i = 0; i < count; ++i)
+            result[i] = bsdf->Derived::eval(bRec[i]);
+    }
+
+    void pdfBatch(size_t count, const BSDFQueryRecord *bRec,
+            float *result) const {
+        const Derived *bsdf = static_cast<const Derived *>(this);
+        for (size_t i = 0; i < count; ++i)
+            result[i] = bsdf->Derived::pdf(bRec[i]);
+    }
+};
+
 NORI_NAMESPACE_END
@@ -113,7 +113,10 @@ class ImageBlock;
 class Integrator;
 class KDTree;
 class Emitter;
+class Instance;
+struct Intersection;
 struct EmitterQueryRecord;
+struct FilterTable;
 class Mesh;
 class NoriObject;
 class NoriObjectFactory;
@@ -130,6 +133,11 @@ using std::endl;
 
 typedef Eigen::Matrix<float,    Eigen::Dynamic, Eigen::Dynamic> MatrixXf;
 typedef Eigen::Matrix<uint32_t, Eigen::Dynamic, Eigen::Dynamic> MatrixXu;
+typedef Eigen::Matrix<uint16_t, Eigen::Dynamic, Eigen::Dynamic> MatrixXu16;
+
+/// Read-only views of the above, which may reference memory owned by another object
+typedef Eigen::Map<const MatrixXf> MatrixXfView;
+typedef Eigen::Map<const MatrixXu> MatrixXuView;
 
 /// Simple exception class, which stores a human-readable error description
 class NoriException : public std::runtime_error {
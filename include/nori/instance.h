@@ -0,0 +1,72 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/object.h>
+#include <nori/transform.h>
+#include <nori/bbox.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Transformed copy of a triangle mesh
+ *
+ * Instances are declared using the <tt>&lt;instance ref="..."&gt;</tt>
+ * tag, which references a mesh with a matching \c id attribute that was
+ * declared earlier in the scene. All instances of a mesh share its
+ * geometry and BVH (see \ref Accel::addInstance()), so the memory
+ * usage grows with the number of unique meshes rather than with the
+ * number of instances.
+ *
+ * A referenced mesh is only rendered through its instances; an instance
+ * without a transformation places a copy where the mesh was declared.
+ *
+ * The following properties are supported:
+ *
+ * <tt>toWorld</tt>: object-to-world transformation, which may be animated
+ * using keyframes (default: identity)
+ */
+class Instance : public NoriObject {
+public:
+    Instance(const PropertyList &propList);
+
+    /// Register the referenced mesh (called by the XML parser)
+    void addChild(NoriObject *obj);
+
+    /// Check the referenced mesh
+    void activate();
+
+    /// Return the referenced mesh
+    const Mesh *getMesh() const { return m_mesh; }
+
+    /// Return the object-to-world transformation (at the current frame)
+    const Transform &getTransform() const { return m_toWorld; }
+
+    /// Does the object-to-world transformation change over time?
+    bool isAnimated() const { return m_toWorldAnim.isAnimated(); }
+
+    /// Evaluate the object-to-world transformation at the given frame
+    void setFrame(float frame);
+
+    /**
+     * \brief Return an axis-aligned box that bounds the instance in
+     * world space (computed from the current bounds of the mesh)
+     */
+    BoundingBox3f getBoundingBox() const;
+
+    /// Return a human-readable summary of this instance
+    std::string toString() const;
+
+    EClassType getClassType() const { return EInstance; }
+
+private:
+    const Mesh *m_mesh = nullptr;
+    Transform m_toWorld;
+    AnimatedTransform m_toWorldAnim;
+};
+
+NORI_NAMESPACE_END
@@ -41,6 +41,51 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a camera ray whose
+     * closest intersection has already been found
+     *
+     * Called by the default \ref renderBlock() instead of \ref Li() when
+     * \ref usesPrimaryPackets() returns \c true. The default
+     * implementation ignores \c its and calls \ref Li().
+     *
+     * \param its
+     *    The intersection of the ray with the scene,
+     *    or \c nullptr if the ray escaped
+     */
+    virtual Color3f LiPrimary(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                              const Intersection *its) const {
+        return Li(scene, sampler, ray);
+    }
+
+    /**
+     * \brief Should the default \ref renderBlock() trace camera rays as
+     * packets and pass their intersections to \ref LiPrimary()?
+     *
+     * This pays off for integrators that spend most of their time on
+     * camera rays (e.g. normals or ambient occlusion), since consecutive
+     * camera rays of an image block are highly coherent.
+     */
+    virtual bool usesPrimaryPackets() const { return false; }
+
+    /**
+     * \brief Render all pixel samples of an image block
+     *
+     * The default implementation generates one camera ray per pixel
+     * sample and estimates its radiance using \ref Li() (or traces them
+     * in packets, see \ref usesPrimaryPackets()). Integrators that
+     * process many paths at once (e.g. the wavefront path tracer)
+     * override this method.
+     *
+     * \param scene
+     *    A pointer to the underlying scene
+     * \param sampler
+     *    A pointer to a sample generator that was prepared for the block
+     * \param block
+     *    The image block, which is cleared before rendering
+     */
+    virtual void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) const;
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
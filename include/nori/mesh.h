@@ -59,6 +59,9 @@ struct Intersection {
  * for querying the individual triangles. Subclasses of \c Mesh implement
  * the specifics of how to create its contents (e.g. by loading from an
  * external file)
+ *
+ * Meshes can optionally be stored in compressed form (see \ref compress()),
+ * which roughly halves the memory used by the mesh itself.
  */
 class Mesh : public NoriObject {
 public:
@@ -69,10 +72,14 @@ public:
     virtual void activate();
 
     /// Return the total number of triangles in this shape
-    uint32_t getTriangleCount() const { return (uint32_t) m_F.cols(); }
+    uint32_t getTriangleCount() const {
+        return (uint32_t) (m_F16.size() > 0 ? m_F16.cols() : m_F.cols());
+    }
 
     /// Return the total number of vertices in this shape
-    uint32_t getVertexCount() const { return (uint32_t) m_V.cols(); }
+    uint32_t getVertexCount() const {
+        return (uint32_t) (m_compressed ? m_VQuant.cols() : m_V.cols());
+    }
 
     /** \brief Uniformly sample position on the surface
      * \param sampler
@@ -91,10 +98,10 @@ public:
     /// Return the surface area of the given triangle
     float surfaceArea(uint32_t index) const;
 
-    //// Return an axis-aligned bounding box of the entire mesh
+    //// Return an axis-aligned bounding box of the entire mesh (over the whole shutter interval)
     const BoundingBox3f &getBoundingBox() const { return m_bbox; }
 
-    //// Return an axis-aligned bounding box containing the given triangle
+    //// Return an axis-aligned bounding box containing the given triangle (over the whole shutter interval)
     BoundingBox3f getBoundingBox(uint32_t index) const;
 
     //// Return the centroid of the given triangle
@@ -127,17 +134,139 @@ public:
      */
     bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const;
 
-    /// Return a pointer to the vertex positions
-    const MatrixXf &getVertexPositions() const { return m_V; }
+    /// Return a pointer to the vertex positions (empty for compressed meshes)
+    const MatrixXfView &getVertexPositions() const { return m_V; }
+
+    /**
+     * \brief Replace the vertex positions (e.g. to animate the mesh)
+     *
+     * The number of vertices and the triangles must stay the same. BVHs
+     * containing the mesh are updated using \ref Accel::refit(). Not
+     * supported for compressed meshes.
+     */
+    void setVertexPositions(const MatrixXf &V);
+
+    /// Replace the vertex normals (an empty matrix removes them)
+    void setVertexNormals(const MatrixXf &N);
+
+    /**
+     * \brief Does the mesh deform over the course of an animation?
+     *
+     * Animated meshes (e.g. OBJ sequences) replace their vertex positions
+     * in \ref setFrame(), after which the BVHs containing them must be
+     * refit (see \ref Scene::setFrame()).
+     */
+    virtual bool isAnimated() const { return false; }
+
+    /**
+     * \brief Does the mesh move during the shutter interval?
+     *
+     * Moving meshes store a second set of vertex positions (and normals)
+     * at the end of the shutter interval. Their vertices move linearly
+     * from \ref getVertexPositions() at time 0 to
+     * \ref getVertexPositionsEnd() at time 1 (see \ref Ray3f::time).
+     */
+    bool hasMotion() const { return m_VEnd.size() > 0; }
 
-    /// Return a pointer to the vertex normals (or \c nullptr if there are none)
-    const MatrixXf &getVertexNormals() const { return m_N; }
+    /// Return a pointer to the vertex positions at the end of the shutter interval
+    const MatrixXf &getVertexPositionsEnd() const { return m_VEnd; }
 
-    /// Return a pointer to the texture coordinates (or \c nullptr if there are none)
-    const MatrixXf &getVertexTexCoords() const { return m_UV; }
+    /// Return a pointer to the vertex normals at the end of the shutter interval
+    const MatrixXf &getVertexNormalsEnd() const { return m_NEnd; }
 
-    /// Return a pointer to the triangle vertex index list
-    const MatrixXu &getIndices() const { return m_F; }
+    /**
+     * \brief Set the vertex positions (and optionally normals) at the
+     * end of the shutter interval
+     *
+     * Empty matrices make the mesh static again. Must be called before the
+     * mesh is added to a BVH.
+     */
+    void setVertexPositionsEnd(const MatrixXf &V, const MatrixXf &N = MatrixXf());
+
+    /// Return the position of a vertex at the given time
+    Point3f getVertexPosition(uint32_t index, float time) const {
+        if (m_compressed)
+            return m_VOffset + m_VScale.cwiseProduct(m_VQuant.col(index).cast<float>());
+        if (m_VEnd.size() == 0)
+            return m_V.col(index);
+        return (1 - time) * m_V.col(index) + time * m_VEnd.col(index);
+    }
+
+    /// Return the (unnormalized) normal of a vertex at the given time
+    Normal3f getVertexNormal(uint32_t index, float time) const {
+        if (m_compressed)
+            return decodeNormal(m_NQuant(0, index));
+        if (m_NEnd.size() == 0)
+            return m_N.col(index);
+        return (1 - time) * m_N.col(index) + time * m_NEnd.col(index);
+    }
+
+    /// Return the texture coordinates of a vertex
+    Point2f getVertexTexCoord(uint32_t index) const {
+        if (m_compressed)
+            return m_UVOffset + m_UVScale.cwiseProduct(m_UVQuant.col(index).cast<float>());
+        return m_UV.col(index);
+    }
+
+    /// Return the index of vertex \c k (0, 1, or 2) of the given triangle
+    uint32_t getVertexIndex(uint32_t index, int k) const {
+        return m_F16.size() > 0 ? (uint32_t) m_F16(k, index) : m_F(k, index);
+    }
+
+    /// Does the mesh provide vertex normals?
+    bool hasVertexNormals() const { return m_N.size() > 0 || m_NQuant.size() > 0; }
+
+    /// Does the mesh provide texture coordinates?
+    bool hasVertexTexCoords() const { return m_UV.size() > 0 || m_UVQuant.size() > 0; }
+
+    /// Return a pointer to the vertex normals (empty if there are none or the mesh is compressed)
+    const MatrixXfView &getVertexNormals() const { return m_N; }
+
+    /// Return a pointer to the texture coordinates (empty if there are none or the mesh is compressed)
+    const MatrixXfView &getVertexTexCoords() const { return m_UV; }
+
+    /**
+     * \brief Return a pointer to the triangle vertex index list
+     *
+     * Empty for compressed meshes with 16-bit indices, use
+     * \ref getVertexIndex() instead
+     */
+    const MatrixXuView &getIndices() const { return m_F; }
+
+    /**
+     * \brief Convert the mesh into a compressed representation
+     *
+     * Vertex positions are quantized to 16 bits per coordinate relative
+     * to the bounding box of the mesh, normals are stored using a 32-bit
+     * octahedral encoding, texture coordinates are quantized to 16 bits
+     * per coordinate relative to their bounds, and indices use 16 bits
+     * when the mesh has at most 65536 vertices.
+     *
+     * The compressed data is decoded on access (\ref getVertexPosition(),
+     * \ref getVertexNormal(), \ref getVertexTexCoord()), and the
+     * matrices returned by \ref getVertexPositions(), \ref getVertexNormals(),
+     * and \ref getVertexTexCoords() are empty afterwards. A BVH over
+     * compressed meshes therefore doesn't keep a full-precision copy of
+     * their triangles by default and decodes the vertices in every
+     * intersection test instead (see the <tt>precomputeTriangles</tt>
+     * property of \ref Accel). Moving meshes can't be compressed.
+     */
+    void compress();
+
+    /// Is the mesh stored in compressed form (see \ref compress())?
+    bool isCompressed() const { return m_compressed; }
+
+    /**
+     * \brief Does the mesh reference a memory-mapped file?
+     *
+     * A BVH over such meshes doesn't copy their triangles by default
+     * (see the <tt>precomputeTriangles</tt> property of \ref Accel),
+     * since that would read the whole file into memory
+     */
+    virtual bool isMemoryMapped() const { return false; }
+
+    /// Return the number of bytes used by the vertices and triangles of the mesh
+    size_t getMemoryUsage() const;
 
     /// Is this mesh an area emitter?
     bool isEmitter() const { return m_emitter != nullptr; }
@@ -170,12 +299,55 @@ protected:
     /// Create an empty mesh
     Mesh();
 
+    /// Recompute \ref m_bbox from the vertex positions
+    void updateBoundingBox();
+
+    /// Point the views \ref m_V, \ref m_N, \ref m_UV, and \ref m_F at the matrices owned by the mesh
+    void updateViews();
+
+    /// Point a view at the given data (e.g. a memory-mapped file)
+    template <typename Matrix> static void setView(Eigen::Map<const Matrix> &view,
+            const typename Matrix::Scalar *data, Eigen::Index rows, Eigen::Index cols) {
+        new (&view) Eigen::Map<const Matrix>(data, rows, cols);
+    }
+
+    /// Encode a normal using two 16-bit coordinates on the octahedron
+    static uint32_t encodeNormal(const Normal3f &n);
+
+    /// Decode a normal stored by \ref encodeNormal()
+    static Normal3f decodeNormal(uint32_t value) {
+        float x = (int16_t) (value & 0xFFFF) * (1.f / 32767.f),
+              y = (int16_t) (value >> 16) * (1.f / 32767.f),
+              z = 1.f - std::abs(x) - std::abs(y);
+        if (z < 0) {
+            float tx = x;
+            x = std::copysign(1.f - std::abs(y), tx);
+            y = std::copysign(1.f - std::abs(tx), y);
+        }
+        return Normal3f(x, y, z).normalized();
+    }
+
 protected:
     std::string   m_name;                   ///< Identifying name
-    MatrixXf      m_V;                      ///< Vertex positions
-    MatrixXf      m_N;                      ///< Vertex normals
-    MatrixXf      m_UV;                     ///< Vertex texture coordinates
-    MatrixXu      m_F;                      ///< Faces
+    MatrixXfView  m_V;                      ///< Vertex positions
+    MatrixXfView  m_N;                      ///< Vertex normals
+    MatrixXfView  m_UV;                     ///< Vertex texture coordinates
+    MatrixXuView  m_F;                      ///< Faces
+    MatrixXf      m_VStorage;               ///< Vertex positions owned by the mesh
+    MatrixXf      m_NStorage;               ///< Vertex normals owned by the mesh
+    MatrixXf      m_UVStorage;              ///< Vertex texture coordinates owned by the mesh
+    MatrixXu      m_FStorage;               ///< Faces owned by the mesh
+    MatrixXf      m_VEnd;                   ///< Vertex positions at the end of the shutter interval
+    MatrixXf      m_NEnd;                   ///< Vertex normals at the end of the shutter interval
+    bool          m_compressed = false;     ///< Is the mesh compressed (see \ref compress())?
+    MatrixXu16    m_VQuant;                 ///< Quantized vertex positions
+    MatrixXu      m_NQuant;                 ///< Octahedral vertex normals
+    MatrixXu16    m_UVQuant;                ///< Quantized vertex texture coordinates
+    MatrixXu16    m_F16;                    ///< Faces with 16-bit indices
+    Point3f       m_VOffset;                ///< Position of the quantized value 0
+    Vector3f      m_VScale;                 ///< Position step per quantized unit
+    Point2f       m_UVOffset;               ///< Texture coordinates of the quantized value 0
+    Vector2f      m_UVScale;                ///< Texture coordinate step per quantized unit
     BSDF         *m_bsdf = nullptr;         ///< BSDF of the surface
     Emitter      *m_emitter = nullptr;      ///< Associated emitter, if any
     DiscretePDF  *m_dpdf = nullptr;         ///< dpdf of the mesh
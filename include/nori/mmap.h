@@ -0,0 +1,51 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <filesystem/path.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Read-only memory mapping of a file
+ *
+ * The operating system reads the pages of the file on demand and may
+ * evict them again under memory pressure, so the file can be larger than
+ * the available memory. Processes that map the same file share its pages.
+ */
+class MemoryMappedFile {
+public:
+    /// Map the given file into memory (throws a \ref NoriException upon failure)
+    MemoryMappedFile(const filesystem::path &filename);
+
+    /// Release the mapping
+    ~MemoryMappedFile();
+
+    /// Return a pointer to the contents of the file
+    const uint8_t *getData() const { return m_data; }
+
+    /// Return the size of the file in bytes
+    size_t getSize() const { return m_size; }
+
+    /// Return the name of the mapped file
+    const filesystem::path &getFilename() const { return m_filename; }
+
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+private:
+    filesystem::path m_filename;
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,62 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <filesystem/path.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Header of binary Nori mesh files (<tt>.nmesh</tt>)
+ *
+ * The header is followed by the vertex positions (3 floats per vertex),
+ * the optional vertex normals (3 floats per vertex) and texture
+ * coordinates (2 floats per vertex), and the triangles (3 vertex indices
+ * of type \c uint32_t each). These arrays use the column-major layout of
+ * \ref Mesh and each of them starts at a multiple of \ref Alignment bytes,
+ * which allows meshes to reference them directly in a memory-mapped file.
+ * All values are stored in little-endian byte order. The vertex and
+ * triangle counts must fit into 32 bits, and all vertex indices must be
+ * smaller than the vertex count (the loader checks both).
+ *
+ * Use the \c obj2nmesh tool to convert Wavefront OBJ files.
+ */
+struct NoriMeshHeader {
+    enum {
+        Version = 1,
+        Alignment = 64
+    };
+
+    enum EFlags {
+        EHasNormals = 0x1,
+        EHasTexCoords = 0x2
+    };
+
+    char magic[8];          ///< "NORIMSH" (null-terminated)
+    uint32_t version;       ///< File format version (\ref Version)
+    uint32_t flags;         ///< Combination of \ref EFlags
+    uint64_t vertexCount;   ///< Number of vertices
+    uint64_t triangleCount; ///< Number of triangles
+    float bboxMin[3];       ///< Minimum of the bounding box
+    float bboxMax[3];       ///< Maximum of the bounding box
+    uint64_t reserved;      ///< Unused (zero)
+
+    /**
+     * \brief Return the offsets of the positions, normals, texture
+     * coordinates, and triangles, and the total size of the file
+     *
+     * \return \c false if the counts exceed 32 bits, in which case the
+     * layout is undefined
+     */
+    bool getLayout(uint64_t offsets[4], uint64_t &fileSize) const;
+};
+
+/// Write a triangle mesh into a binary Nori mesh file
+extern void writeNoriMesh(const Mesh *mesh, const filesystem::path &filename);
+
+NORI_NAMESPACE_END
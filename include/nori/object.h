@@ -30,6 +30,7 @@ public:
         ESampler,
         ETest,
         EReconstructionFilter,
+        EInstance,
         EClassTypeCount
     };
 
@@ -72,6 +73,14 @@ public:
      */
     virtual void activate();
 
+    /**
+     * \brief Move to the given frame of an animation
+     *
+     * Objects with animated properties (e.g. keyframed transformations)
+     * override this function. The default implementation does nothing.
+     */
+    virtual void setFrame(float frame);
+
     /// Return a brief string summary of the instance (for debugging purposes)
     virtual std::string toString() const = 0;
     
@@ -86,6 +95,7 @@ public:
             case EIntegrator: return "integrator";
             case ESampler:    return "sampler";
             case ETest:       return "test";
+            case EInstance:   return "instance";
             default:          return "<unknown>";
         }
     }
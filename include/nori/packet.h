@@ -0,0 +1,165 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/mesh.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Bundle of coherent rays that are traversed together
+ *
+ * The ray data is stored in structure-of-arrays layout using fixed-size
+ * Eigen arrays, which Eigen maps onto SSE/AVX registers (depending on the
+ * instruction sets enabled at compile time). This makes it possible to
+ * test all rays of a packet against a bounding box using a handful of
+ * vector instructions, which pays off for highly coherent rays such as
+ * the primary rays of a single image block.
+ *
+ * Lanes that are not in use must be disabled in the \ref active mask.
+ *
+ * \tparam Size Number of rays in the packet (typically 4, 8, or 16)
+ */
+template <int _Size> struct TRayPacket {
+    enum {
+        Size = _Size
+    };
+
+    typedef Eigen::Array<float, Size, 1> FloatPacket;
+    typedef Eigen::Array<bool, Size, 1>  MaskPacket;
+
+    FloatPacket o[3];    ///< Ray origins (one array per dimension)
+    FloatPacket d[3];    ///< Ray directions (one array per dimension)
+    FloatPacket dRcp[3]; ///< Componentwise reciprocals of the ray directions
+    FloatPacket mint;    ///< Minimum positions on the ray segments
+    FloatPacket maxt;    ///< Maximum positions on the ray segments
+    FloatPacket time;    ///< Times within the shutter interval
+    MaskPacket active;   ///< Lanes that contain a valid ray
+
+    /// Create an empty packet (all lanes disabled)
+    TRayPacket() {
+        for (int i=0; i<3; ++i) {
+            o[i].setZero(); d[i].setZero(); dRcp[i].setZero();
+        }
+        mint.setConstant(Epsilon);
+        maxt.setConstant(std::numeric_limits<float>::infinity());
+        time.setZero();
+        active.setConstant(false);
+    }
+
+    /**
+     * \brief Store a ray in lane \c i and enable it
+     *
+     * Reciprocals of zero direction components are replaced by a large
+     * finite value, which keeps the SIMD slab test free of NaNs.
+     */
+    void setRay(int i, const Ray3f &ray) {
+        for (int k=0; k<3; ++k) {
+            o[k][i] = ray.o[k];
+            d[k][i] = ray.d[k];
+            dRcp[k][i] = ray.d[k] != 0 ? ray.dRcp[k]
+                : std::numeric_limits<float>::max();
+        }
+        mint[i] = ray.mint;
+        maxt[i] = ray.maxt;
+        time[i] = ray.time;
+        active[i] = true;
+    }
+
+    /// Return the ray stored in lane \c i
+    Ray3f getRay(int i) const {
+        Ray3f ray;
+        getRay(i, ray);
+        return ray;
+    }
+
+    /// Copy the ray stored in lane \c i into an existing ray
+    void getRay(int i, Ray3f &ray) const {
+        ray.o = Point3f(o[0][i], o[1][i], o[2][i]);
+        ray.d = Vector3f(d[0][i], d[1][i], d[2][i]);
+        ray.dRcp = Vector3f(dRcp[0][i], dRcp[1][i], dRcp[2][i]);
+        ray.mint = mint[i];
+        ray.maxt = maxt[i];
+        ray.time = time[i];
+    }
+
+    /// Return the number of enabled lanes
+    int getActiveCount() const { return (int) active.count(); }
+
+    /**
+     * \brief Slab test of all rays against a bounding box
+     *
+     * \return A mask of the active lanes whose ray segment
+     *         overlaps the bounding box
+     */
+    MaskPacket rayIntersect(const BoundingBox3f &bbox) const {
+        FloatPacket nearT;
+        return rayIntersect(bbox, nearT);
+    }
+
+    /**
+     * \brief Slab test of all rays against a bounding box that
+     * also returns the entry distances
+     *
+     * \return A mask of the active lanes whose ray segment
+     *         overlaps the bounding box
+     */
+    MaskPacket rayIntersect(const BoundingBox3f &bbox, FloatPacket &nearT) const {
+        FloatPacket farT = maxt;
+        nearT = mint;
+        for (int i=0; i<3; ++i) {
+            FloatPacket t1 = (bbox.min[i] - o[i]) * dRcp[i];
+            FloatPacket t2 = (bbox.max[i] - o[i]) * dRcp[i];
+            nearT = nearT.max(t1.min(t2));
+            farT  = farT.min(t1.max(t2));
+        }
+        return active && (nearT <= farT);
+    }
+
+    /// Return a human-readable string summary of this packet
+    std::string toString() const {
+        std::string result;
+        for (int i=0; i<Size; ++i) {
+            if (!active[i])
+                continue;
+            result += "  " + indent(getRay(i).toString()) + "\n";
+        }
+        return tfm::format("RayPacket[size=%i, active=%i,\n%s]",
+                           (int) Size, getActiveCount(), result);
+    }
+};
+
+/**
+ * \brief Intersection records for all lanes of a \ref TRayPacket
+ *
+ * Lanes without an intersection have \c valid set to \c false and
+ * leave the corresponding \ref Intersection record untouched.
+ */
+template <int _Size> struct TIntersectionPacket {
+    enum {
+        Size = _Size
+    };
+
+    typedef typename TRayPacket<Size>::MaskPacket MaskPacket;
+
+    Intersection its[Size]; ///< Per-lane intersection records
+    MaskPacket valid;       ///< Lanes that found an intersection
+
+    TIntersectionPacket() { valid.setConstant(false); }
+
+    Intersection &operator[](int i) { return its[i]; }
+    const Intersection &operator[](int i) const { return its[i]; }
+};
+
+typedef TRayPacket<4>           RayPacket4;
+typedef TRayPacket<8>           RayPacket8;
+typedef TRayPacket<16>          RayPacket16;
+typedef TIntersectionPacket<4>  IntersectionPacket4;
+typedef TIntersectionPacket<8>  IntersectionPacket8;
+typedef TIntersectionPacket<16> IntersectionPacket16;
+
+NORI_NAMESPACE_END
@@ -20,6 +20,11 @@ class PropertyList {
 public:
     PropertyList() { }
 
+    /// Check whether a property with the given name exists
+    bool has(const std::string &name) const {
+        return m_properties.find(name) != m_properties.end();
+    }
+
     /// Set a boolean property
     void setBoolean(const std::string &name, const bool &value);
     
@@ -91,13 +96,27 @@ public:
 
     /// Get a transform property, and use a default value if it does not exist
     Transform getTransform(const std::string &name, const Transform &defaultValue) const;
+
+    /// Add a keyframe to an animated transform property
+    void addTransformKeyframe(const std::string &name, float time, const Transform &value);
+
+    /**
+     * \brief Get an animated transform property, and throw an exception
+     * if it does not exist (plain transform properties are also accepted)
+     */
+    AnimatedTransform getAnimatedTransform(const std::string &name) const;
+
+    /// Get an animated transform property, and use a default value if it does not exist
+    AnimatedTransform getAnimatedTransform(const std::string &name,
+        const AnimatedTransform &defaultValue) const;
 private:
     /* Custom variant data type (stores one of boolean/integer/float/...) */
     struct Property {
         enum {
             boolean_type, integer_type, float_type,
             string_type, color_type, point_type,
-            vector_type, transform_type
+            vector_type, transform_type,
+            animated_transform_type
         } type;
 
         /* Visual studio lacks support for unrestricted unions (as of ver. 2013) */
@@ -114,6 +133,7 @@ private:
             Point3f point_value;
             Vector3f vector_value;
             Transform transform_value;
+            AnimatedTransform animated_transform_value;
         } value;
 
         Property() : type(boolean_type) { }
@@ -13,6 +13,24 @@
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Reconstruction filter tabulated at \ref NORI_FILTER_RESOLUTION
+ * points over its radius
+ *
+ * The table is computed once when the filter is activated and is never
+ * modified afterwards, so all image blocks (and threads) can share it.
+ */
+struct FilterTable {
+    /// Filter radius in fractional pixels
+    float radius = 0.0f;
+    /// Scale factor that turns a distance into a table index
+    float lookupFactor = 0.0f;
+    /// Number of pixels an image block needs around its border
+    int borderSize = 0;
+    /// Filter values (the last entry is always zero)
+    float values[NORI_FILTER_RESOLUTION + 1];
+};
+
 /**
  * \brief Generic radially symmetric image reconstruction filter
  *
@@ -33,6 +51,12 @@ public:
     /// Evaluate the filter function
     virtual float eval(float x) const = 0;
 
+    /// Return the tabulated filter (only valid after \ref activate())
+    const FilterTable &getTable() const { return m_table; }
+
+    /// Tabulate the filter function
+    void activate();
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
@@ -40,6 +64,7 @@ public:
     EClassType getClassType() const { return EReconstructionFilter; }
 protected:
     float m_radius;
+    FilterTable m_table;
 };
 
 NORI_NAMESPACE_END
@@ -13,6 +13,9 @@ NORI_NAMESPACE_BEGIN
 
 class ImageBlock;
 
+/// Number of samples per pixel of an image (used for adaptive sampling)
+typedef Eigen::Array<uint32_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> SampleMap;
+
 /**
  * \brief Abstract sample generator
  *
@@ -82,9 +85,40 @@ public:
     /// Retrieve the next two component values from the current sample
     virtual Point2f next2D() = 0;
 
+    /**
+     * \brief Configure the sampler for one pass of a progressive render
+     *
+     * Progressive rendering splits the pixel samples into several passes
+     * over the whole image. Afterwards, \ref getSampleCount() returns the
+     * number of samples of the pass, and the following calls to
+     * \ref prepare() must produce samples that are independent of those
+     * of all other passes. Pass 0 generates the same samples as a
+     * sampler that was never configured for a pass.
+     */
+    virtual void setPass(int pass, size_t sampleCount) {
+        m_pass = pass;
+        m_sampleCount = sampleCount;
+    }
+
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /**
+     * \brief Assign an individual number of samples to every pixel
+     *
+     * Adaptive sampling uses this to concentrate the samples of a pass in
+     * the pixels that have not converged yet. The map covers the whole
+     * image and must outlive its use; \c nullptr restores the uniform
+     * sample count.
+     */
+    void setSampleMap(const SampleMap *map) { m_sampleMap = map; }
+
+    /// Return the number of samples to be taken in the given pixel of the image
+    size_t getPixelSampleCount(const Point2i &pixel) const {
+        return m_sampleMap ? (size_t) m_sampleMap->coeff(pixel.y(), pixel.x())
+                           : getSampleCount();
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -92,6 +126,8 @@ public:
     EClassType getClassType() const { return ESampler; }
 protected:
     size_t m_sampleCount;
+    int m_pass = 0;
+    const SampleMap *m_sampleMap = nullptr;
 };
 
 NORI_NAMESPACE_END
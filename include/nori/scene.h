@@ -19,7 +19,18 @@ NORI_NAMESPACE_BEGIN
  */
 class Scene : public NoriObject {
 public:
-    /// Construct a new scene object
+    /**
+     * \brief Construct a new scene object
+     *
+     * Besides the parameters of the BVH (see \ref Accel::Accel()), the
+     * following (optional) properties are supported:
+     *
+     * <tt>frameStart</tt>, <tt>frameEnd</tt>: range of frames rendered
+     * in animation mode (inclusive). The camera and instances can be
+     * animated using keyframed transformations, e.g.
+     * <tt>&lt;transform name="toWorld" frame="10"&gt;</tt>
+     * (default: 0 and 0, i.e. a single image)
+     */
     Scene(const PropertyList &);
 
     /// Release all memory
@@ -64,6 +75,24 @@ public:
         return m_accel->rayIntersect(ray, its, false);
     }
 
+    /**
+     * \brief Intersect a packet of coherent rays against all triangles
+     * stored in the scene and return detailed intersection information
+     *
+     * \param packet
+     *    A bundle of rays (e.g. camera rays of neighboring pixels)
+     *
+     * \param its
+     *    Per-ray intersection records, which will be filled by the
+     *    intersection query
+     *
+     * \return \c true if at least one intersection was found
+     */
+    template <int Size> bool rayIntersect(const TRayPacket<Size> &packet,
+            TIntersectionPacket<Size> &its) const {
+        return m_accel->rayIntersect(packet, its);
+    }
+
     /**
      * \brief Intersect a ray against all triangles stored in the scene
      * and \a only determine whether or not there is an intersection.
@@ -80,10 +109,49 @@ public:
      * \return \c true if an intersection was found
      */
     bool rayIntersect(const Ray3f &ray) const {
-        Intersection its; /* Unused */
-        return m_accel->rayIntersect(ray, its, true);
+        return m_accel->occluded(ray);
+    }
+
+    /**
+     * \brief Check a packet of shadow rays for occlusion
+     *
+     * \param packet
+     *    A bundle of shadow rays
+     *
+     * \return A mask of the active lanes that found an intersection
+     */
+    template <int Size> typename TRayPacket<Size>::MaskPacket
+            rayIntersect(const TRayPacket<Size> &packet) const {
+        return m_accel->occluded(packet);
     }
 
+    /// Return the first frame of the animation
+    int getFrameStart() const { return m_frameStart; }
+
+    /// Return the last frame of the animation (inclusive)
+    int getFrameEnd() const { return m_frameEnd; }
+
+    /// Does the scene describe an animation with multiple frames?
+    bool isAnimated() const { return m_frameEnd > m_frameStart; }
+
+    /**
+     * \brief Does any mesh move during the shutter interval?
+     *
+     * Camera rays then need a random time (see \ref Ray3f::time),
+     * which makes moving meshes appear motion-blurred.
+     */
+    bool hasMotion() const { return m_motion; }
+
+    /**
+     * \brief Move the camera, all instances, and deforming meshes to
+     * the given frame
+     *
+     * BVHs over deforming meshes (see \ref Mesh::isAnimated()) are refit
+     * (see \ref Accel::refit()); otherwise, only the top-level BVH over
+     * instances is updated. BSDFs and emitters are shared by all frames.
+     */
+    void setFrame(float frame);
+
     /// \brief Return an axis-aligned box that bounds the scene
     const BoundingBox3f &getBoundingBox() const {
         return m_accel->getBoundingBox();
@@ -97,7 +165,7 @@ public:
      */
     void activate();
 
-    /// Add a child object to the scene (meshes, integrators etc.)
+    /// Add a child object to the scene (meshes, instances, integrators etc.)
     void addChild(NoriObject *obj);
 
     // If there are several light sources in the scene,
@@ -112,11 +180,16 @@ public:
     EClassType getClassType() const { return EScene; }
 private:
     std::vector<Mesh *> m_meshes;
+    std::vector<Instance *> m_instances;
     std::vector<Emitter *> m_emitters;
     Integrator *m_integrator = nullptr;
     Sampler *m_sampler = nullptr;
     Camera *m_camera = nullptr;
     Accel *m_accel = nullptr;
+    int m_frameStart = 0;
+    int m_frameEnd = 0;
+    float m_frame = 0;
+    bool m_motion = false;
 };
 
 NORI_NAMESPACE_END
@@ -69,11 +69,13 @@ public:
 
     /// Apply the homogeneous transformation to a ray
     Ray3f operator*(const Ray3f &r) const {
-        return Ray3f(
+        Ray3f result(
             operator*(r.o), 
             operator*(r.d), 
             r.mint, r.maxt
         );
+        result.time = r.time;
+        return result;
     }
 
     /// Return a string representation
@@ -83,4 +85,35 @@ private:
     Eigen::Matrix4f m_inverse;
 };
 
+/**
+ * \brief Transformation that is interpolated between keyframes
+ *
+ * Keyframes are decomposed into a translation, a rotation, and a
+ * remaining scale/shear part, which are interpolated separately (linearly,
+ * using spherical linear interpolation, and linearly). Before the first
+ * and after the last keyframe, the transformation stays constant.
+ */
+struct AnimatedTransform {
+public:
+    /// Create an animated transform without keyframes (i.e. the identity)
+    AnimatedTransform() { }
+
+    /// Create a constant animated transform
+    AnimatedTransform(const Transform &trafo) { addKeyframe(0.0f, trafo); }
+
+    /// Add a keyframe (replaces an existing keyframe at the same time)
+    void addKeyframe(float time, const Transform &trafo);
+
+    /// Does the transformation change over time?
+    bool isAnimated() const { return m_keyframes.size() > 1; }
+
+    /// Return the interpolated transformation at the given time
+    Transform eval(float time) const;
+
+    /// Return a string representation
+    std::string toString() const;
+private:
+    std::vector<std::pair<float, Transform>> m_keyframes;
+};
+
 NORI_NAMESPACE_END
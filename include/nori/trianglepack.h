@@ -0,0 +1,83 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/vector.h>
+#include <nori/ray.h>
+
+/* The pack width follows the instruction set selected at compile time
+   (see the NORI_SIMD option in CMakeLists.txt) */
+#if defined(NORI_SIMD_AVX512)
+#  define NORI_TRIANGLE_PACK_SIZE 16
+#elif defined(NORI_SIMD_AVX2)
+#  define NORI_TRIANGLE_PACK_SIZE 8
+#else
+#  define NORI_TRIANGLE_PACK_SIZE 4
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Group of triangles stored in structure-of-arrays layout
+ *
+ * This is the input of the vectorized leaf intersection kernels, which
+ * test one ray against all triangles of a pack at once. Unused lanes
+ * hold degenerate triangles that are never intersected.
+ */
+struct alignas(64) TrianglePack {
+    enum {
+        Size = NORI_TRIANGLE_PACK_SIZE
+    };
+
+    float p0[3][Size];       ///< First vertex (per dimension)
+    float e1[3][Size];       ///< Edge from the first to the second vertex
+    float e2[3][Size];       ///< Edge from the first to the third vertex
+    uint32_t mesh[Size];     ///< Index of the mesh (within the BVH)
+    uint32_t index[Size];    ///< Index of the triangle within the mesh
+
+    /// Create a pack of degenerate triangles
+    TrianglePack() { memset(this, 0, sizeof(TrianglePack)); }
+
+    /// Store a triangle in the given lane
+    void set(int lane, const Point3f &v0, const Point3f &v1, const Point3f &v2,
+             uint32_t meshIdx, uint32_t triIdx) {
+        for (int i=0; i<3; ++i) {
+            p0[i][lane] = v0[i];
+            e1[i][lane] = v1[i] - v0[i];
+            e2[i][lane] = v2[i] - v0[i];
+        }
+        mesh[lane] = meshIdx;
+        index[lane] = triIdx;
+    }
+};
+
+/**
+ * \brief Intersect a ray against all triangles of a pack
+ *
+ * Uses the Moeller-Trumbore test (see \ref Mesh::rayIntersect()).
+ *
+ * \return The lane of the closest intersection within
+ *         <tt>[ray.mint, ray.maxt]</tt>, or -1 if there is none.
+ *         On success, \c u, \c v, and \c t are set accordingly.
+ */
+typedef int (*TrianglePackIntersector)(const TrianglePack &pack,
+    const Ray3f &ray, float &u, float &v, float &t);
+
+/**
+ * \brief Return the vectorized kernel matching the instruction set
+ * that Nori was compiled for
+ *
+ * Returns \c nullptr when the kernel was disabled at compile time or
+ * when the processor lacks the required instruction set. Callers are
+ * expected to use scalar intersection code in that case.
+ *
+ * \param name
+ *    Receives the name of the instruction set (e.g. "AVX2")
+ */
+extern TrianglePackIntersector getTrianglePackIntersector(std::string &name);
+
+NORI_NAMESPACE_END
@@ -17,10 +17,14 @@
 */
 
 #include <nori/accel.h>
+#include <nori/instance.h>
 #include <nori/timer.h>
+#include <filesystem/resolver.h>
 #include <tbb/tbb.h>
 #include <Eigen/Geometry>
 #include <atomic>
+#include <fstream>
+#include <random>
 
 /*
  * =======================================================================
@@ -33,12 +37,28 @@
 
 NORI_NAMESPACE_BEGIN
 
-/* Bin data structure for counting triangles and computing their bounding box */
+/* Bin data structure for counting triangles and computing their bounding box
+   (one set of bins per axis) */
 struct Bins {
-    static const int BIN_COUNT = 16;
-    Bins() { memset(counts, 0, sizeof(uint32_t) * BIN_COUNT); }
-    uint32_t counts[BIN_COUNT];
-    BoundingBox3f bbox[BIN_COUNT];
+    static const int MAX_BIN_COUNT = 64;
+    Bins() { memset(counts, 0, sizeof(uint32_t) * 3 * MAX_BIN_COUNT); }
+    uint32_t counts[3][MAX_BIN_COUNT];
+    BoundingBox3f bbox[3][MAX_BIN_COUNT];
+};
+
+/// Split plane found by the binned SAH search
+struct BinnedSplit {
+    int axis;
+    int index;               ///< Last bin on the left side
+    float min[3];            ///< Start of the binned interval (per axis)
+    float inv_bin_size[3];   ///< Inverse bin size (per axis)
+    uint32_t left_count;
+    BoundingBox3f bbox_left, bbox_right;
+
+    /// Return the bin index of a centroid along the split axis
+    int getBin(const Point3f &centroid) const {
+        return (int) ((centroid[axis] - min[axis]) * inv_bin_size[axis]);
+    }
 };
 
 /**
@@ -107,86 +127,26 @@ public:
             return nullptr;
         }
 
-        /* Always split along the largest axis */
-        int axis = node.bbox.getLargestAxis();
-        float min = node.bbox.min[axis], max = node.bbox.max[axis],
-              inv_bin_size = Bins::BIN_COUNT / (max-min);
-
-        /* Accumulate all triangles into bins */
-        Bins bins = tbb::parallel_reduce(
-            tbb::blocked_range<uint32_t>(0u, size, GRAIN_SIZE),
-            Bins(),
-            /* MAP: Bin a number of triangles and return the resulting 'Bins' data structure */
-            [&](const tbb::blocked_range<uint32_t> &range, Bins result) {
-                for (uint32_t i = range.begin(); i != range.end(); ++i) {
-                    uint32_t f = start[i];
-                    float centroid = bvh.getCentroid(f)[axis];
-
-                    int index = std::min(std::max(
-                        (int) ((centroid - min) * inv_bin_size), 0),
-                        (Bins::BIN_COUNT - 1));
-
-                    result.counts[index]++;
-                    result.bbox[index].expandBy(bvh.getBoundingBox(f));
-                }
-                return result;
-            },
-            /* REDUCE: Combine two 'Bins' data structures */
-            [](const Bins &b1, const Bins &b2) {
-                Bins result;
-                for (int i=0; i < Bins::BIN_COUNT; ++i) {
-                    result.counts[i] = b1.counts[i] + b2.counts[i];
-                    result.bbox[i] = BoundingBox3f::merge(b1.bbox[i], b2.bbox[i]);
-                }
-                return result;
-            }
-        );
-
-        /* Choose the best split plane based on the binned data */
-        BoundingBox3f bbox_left[Bins::BIN_COUNT];
-        bbox_left[0] = bins.bbox[0];
-        for (int i=1; i<Bins::BIN_COUNT; ++i) {
-            bins.counts[i] += bins.counts[i-1];
-            bbox_left[i] = BoundingBox3f::merge(bbox_left[i-1], bins.bbox[i]);
-        }
-
-        BoundingBox3f bbox_right = bins.bbox[Bins::BIN_COUNT-1], best_bbox_right;
-        int64_t best_index = -1;
-        float best_cost = (float) INTERSECTION_COST * size;
-        float tri_factor = (float) INTERSECTION_COST / node.bbox.getSurfaceArea();
-
-        for (int i=Bins::BIN_COUNT - 2; i >= 0; --i) {
-            uint32_t prims_left = bins.counts[i], prims_right = (uint32_t) (end - start) - bins.counts[i];
-            float sah_cost = 2.0f * TRAVERSAL_COST +
-                tri_factor * (prims_left * bbox_left[i].getSurfaceArea() +
-                              prims_right * bbox_right.getSurfaceArea());
-            if (sah_cost < best_cost) {
-                best_cost = sah_cost;
-                best_index = i;
-                best_bbox_right = bbox_right;
-            }
-            bbox_right = BoundingBox3f::merge(bbox_right, bins.bbox[i]);
-        }
-
-        if (best_index == -1) {
+        BinnedSplit split;
+        if (!find_binned_split(bvh, node.bbox, start, size, true, split)) {
             /* Could not find a good split plane -- retry with
                more careful serial code just to be sure.. */
-            execute_serially(bvh, node_idx, start, end, temp);
+            execute_sweep(bvh, node_idx, start, end, temp);
             return nullptr;
         }
 
-        uint32_t left_count = bins.counts[best_index];
+        uint32_t left_count = split.left_count;
         int node_idx_left = node_idx+1;
         int node_idx_right = node_idx+2*left_count;
 
-        bvh.m_nodes[node_idx_left ].bbox = bbox_left[best_index];
-        bvh.m_nodes[node_idx_right].bbox = best_bbox_right;
+        bvh.m_nodes[node_idx_left ].bbox = split.bbox_left;
+        bvh.m_nodes[node_idx_right].bbox = split.bbox_right;
         node.inner.rightChild = node_idx_right;
-        node.inner.axis = axis;
+        node.inner.axis = split.axis;
         node.inner.flag = 0;
 
         std::atomic<uint32_t> offset_left(0),
-                              offset_right(bins.counts[best_index]);
+                              offset_right(left_count);
 
         tbb::parallel_for(
             tbb::blocked_range<uint32_t>(0u, size, GRAIN_SIZE),
@@ -194,17 +154,15 @@ public:
                 uint32_t count_left = 0, count_right = 0;
                 for (uint32_t i = range.begin(); i != range.end(); ++i) {
                     uint32_t f = start[i];
-                    float centroid = bvh.getCentroid(f)[axis];
-                    int index = (int) ((centroid - min) * inv_bin_size);
-                    (index <= best_index ? count_left : count_right)++;
+                    int index = split.getBin(bvh.getCentroid(f));
+                    (index <= split.index ? count_left : count_right)++;
                 }
                 uint32_t idx_l = offset_left.fetch_add(count_left);
                 uint32_t idx_r = offset_right.fetch_add(count_right);
                 for (uint32_t i = range.begin(); i != range.end(); ++i) {
                     uint32_t f = start[i];
-                    float centroid = bvh.getCentroid(f)[axis];
-                    int index = (int) ((centroid - min) * inv_bin_size);
-                    if (index <= best_index)
+                    int index = split.getBin(bvh.getCentroid(f));
+                    if (index <= split.index)
                         temp[idx_l++] = f;
                     else
                         temp[idx_r++] = f;
@@ -232,8 +190,160 @@ public:
         return this;
     }
 
+    /**
+     * \brief Search for the best split plane using binned SAH
+     * evaluation along all three axes
+     *
+     * Uses \ref Accel::m_binCount bins per axis. When \c parallel is set,
+     * the triangles are binned using multiple threads.
+     *
+     * \return \c false if no split plane improves over a leaf node
+     */
+    static bool find_binned_split(const Accel &bvh, const BoundingBox3f &node_bbox,
+                                  const uint32_t *start, uint32_t size,
+                                  bool parallel, BinnedSplit &split) {
+        const int bin_count = bvh.m_binCount;
+        for (int axis=0; axis<3; ++axis) {
+            split.min[axis] = node_bbox.min[axis];
+            float extent = node_bbox.max[axis] - node_bbox.min[axis];
+            split.inv_bin_size[axis] = extent > 0 ? bin_count / extent : 0.0f;
+        }
+
+        /* MAP: Bin a number of triangles */
+        auto binTriangles = [&](uint32_t begin, uint32_t end, Bins &result) {
+            for (uint32_t i = begin; i != end; ++i) {
+                uint32_t f = start[i];
+                Point3f centroid = bvh.getCentroid(f);
+                BoundingBox3f bbox = bvh.getBoundingBox(f);
+
+                for (int axis=0; axis<3; ++axis) {
+                    int index = std::min(std::max(
+                        (int) ((centroid[axis] - split.min[axis]) * split.inv_bin_size[axis]), 0),
+                        (bin_count - 1));
+
+                    result.counts[axis][index]++;
+                    result.bbox[axis][index].expandBy(bbox);
+                }
+            }
+        };
+
+        /* Accumulate all triangles into bins */
+        Bins bins;
+        if (parallel) {
+            bins = tbb::parallel_reduce(
+                tbb::blocked_range<uint32_t>(0u, size, GRAIN_SIZE),
+                Bins(),
+                [&](const tbb::blocked_range<uint32_t> &range, Bins result) {
+                    binTriangles(range.begin(), range.end(), result);
+                    return result;
+                },
+                /* REDUCE: Combine two 'Bins' data structures */
+                [&](const Bins &b1, const Bins &b2) {
+                    Bins result;
+                    for (int axis=0; axis<3; ++axis) {
+                        for (int i=0; i < bin_count; ++i) {
+                            result.counts[axis][i] = b1.counts[axis][i] + b2.counts[axis][i];
+                            result.bbox[axis][i] = BoundingBox3f::merge(b1.bbox[axis][i], b2.bbox[axis][i]);
+                        }
+                    }
+                    return result;
+                }
+            );
+        } else {
+            binTriangles(0u, size, bins);
+        }
+
+        /* Choose the best split plane based on the binned data */
+        float best_cost = (float) INTERSECTION_COST * size;
+        float tri_factor = (float) INTERSECTION_COST / node_bbox.getSurfaceArea();
+        split.index = -1;
+
+        for (int axis=0; axis<3; ++axis) {
+            if (split.inv_bin_size[axis] == 0)
+                continue;
+
+            uint32_t *counts = bins.counts[axis];
+            BoundingBox3f bbox_left[Bins::MAX_BIN_COUNT];
+            bbox_left[0] = bins.bbox[axis][0];
+            for (int i=1; i<bin_count; ++i) {
+                counts[i] += counts[i-1];
+                bbox_left[i] = BoundingBox3f::merge(bbox_left[i-1], bins.bbox[axis][i]);
+            }
+
+            BoundingBox3f bbox_right = bins.bbox[axis][bin_count-1];
+            for (int i=bin_count - 2; i >= 0; --i) {
+                uint32_t prims_left = counts[i], prims_right = size - counts[i];
+                if (prims_left > 0 && prims_right > 0) {
+                    float sah_cost = 2.0f * TRAVERSAL_COST +
+                        tri_factor * (prims_left * bbox_left[i].getSurfaceArea() +
+                                      prims_right * bbox_right.getSurfaceArea());
+                    if (sah_cost < best_cost) {
+                        best_cost = sah_cost;
+                        split.axis = axis;
+                        split.index = i;
+                        split.left_count = prims_left;
+                        split.bbox_left = bbox_left[i];
+                        split.bbox_right = bbox_right;
+                    }
+                }
+                bbox_right = BoundingBox3f::merge(bbox_right, bins.bbox[axis][i]);
+            }
+        }
+
+        return split.index != -1;
+    }
+
+    /// Turn a node into a leaf referencing the given triangles
+    static void make_leaf(Accel &bvh, Accel::BVHNode &node, uint32_t *start, uint32_t size) {
+        node.leaf.flag = 1;
+        node.leaf.start = (uint32_t) (start - bvh.m_indices.data());
+        node.leaf.size  = size;
+    }
+
     /// Single-threaded build function
     static void execute_serially(Accel &bvh, uint32_t node_idx, uint32_t *start, uint32_t *end, uint32_t *temp) {
+        if (bvh.m_fullSweep) {
+            execute_sweep(bvh, node_idx, start, end, temp);
+            return;
+        }
+
+        Accel::BVHNode &node = bvh.m_nodes[node_idx];
+        uint32_t size = (uint32_t) (end - start);
+
+        BoundingBox3f bbox;
+        for (uint32_t *f = start; f != end; ++f)
+            bbox.expandBy(bvh.getBoundingBox(*f));
+        node.bbox = bbox;
+
+        if (size == 1) {
+            make_leaf(bvh, node, start, size);
+            return;
+        }
+
+        BinnedSplit split;
+        if (!find_binned_split(bvh, node.bbox, start, size, false, split)) {
+            /* Binning failed -- fall back to the exact sweep for this node */
+            execute_sweep(bvh, node_idx, start, end, temp);
+            return;
+        }
+
+        std::partition(start, end, [&](uint32_t f) {
+            return split.getBin(bvh.getCentroid(f)) <= split.index;
+        });
+
+        uint32_t left_count = split.left_count;
+        uint32_t node_idx_left = node_idx + 1;
+        uint32_t node_idx_right = node_idx + 2 * left_count;
+        node.inner.rightChild = node_idx_right;
+        node.inner.axis = split.axis;
+        node.inner.flag = 0;
+
+        execute_serially(bvh, node_idx_left, start, start + left_count, temp);
+        execute_serially(bvh, node_idx_right, start+left_count, end, temp + left_count);
+    }
+
+    /// Single-threaded build function evaluating every possible split (full sweep)
+    static void execute_sweep(Accel &bvh, uint32_t node_idx, uint32_t *start, uint32_t *end, uint32_t *temp) {
         Accel::BVHNode &node = bvh.m_nodes[node_idx];
         uint32_t size = (uint32_t) (end - start);
         float best_cost = (float) INTERSECTION_COST * size;
@@ -283,15 +393,16 @@ public:
 
         if (best_index == -1) {
             /* Splitting does not reduce the cost, make a leaf */
-            node.leaf.flag = 1;
-            node.leaf.start = (uint32_t) (start - bvh.m_indices.data());
-            node.leaf.size  = size;
+            make_leaf(bvh, node, start, size);
             return;
         }
 
-        std::sort(start, end, [&](uint32_t f1, uint32_t f2) {
-            return bvh.getCentroid(f1)[best_axis] < bvh.getCentroid(f2)[best_axis];
-        });
+        /* The triangles are still sorted along the last axis */
+        if (best_axis != 2) {
+            std::sort(start, end, [&](uint32_t f1, uint32_t f2) {
+                return bvh.getCentroid(f1)[best_axis] < bvh.getCentroid(f2)[best_axis];
+            });
+        }
 
         uint32_t left_count = (uint32_t) best_index;
         uint32_t node_idx_left = node_idx + 1;
@@ -305,114 +416,1453 @@ public:
     }
 };
 
+/**
+ * \brief Serial builder for BVHs with spatial splits (SBVH)
+ *
+ * In addition to partitioning the triangles (as done by \ref BVHBuildTask),
+ * this builder considers splitting space with an axis-aligned plane.
+ * Triangle references that straddle the plane are clipped and referenced
+ * from both sides, which yields much tighter bounds for long or large
+ * triangles at the cost of duplicate references. The total number of
+ * references is capped by a memory budget.
+ *
+ * The used methodology is that described in
+ * "Spatial Splits in Bounding Volume Hierarchies"
+ * by Martin Stich, Heiko Friedrich, and Andreas Dietrich (Proc. HPG 2009)
+ */
+class SBVHBuilder {
+public:
+    /// Build-related parameters
+    enum {
+        /// Don't create trees deeper than the traversal stacks can handle
+        MAX_DEPTH = 60
+    };
+
+    SBVHBuilder(Accel &bvh) : bvh(bvh) { }
+
+    /// Build the tree, which fills \ref Accel::m_nodes and \ref Accel::m_indices
+    void build() {
+        uint32_t size = bvh.getTriangleCount();
+        std::vector<Reference> refs(size);
+        for (uint32_t i = 0; i < size; ++i) {
+            refs[i].index = i;
+            refs[i].bbox = bvh.getBoundingBox(i);
+        }
+
+        m_refCount = size;
+        m_maxRefs = (uint64_t) (size * (1.0 + bvh.m_spatialSplitBudget));
+        m_rootArea = bvh.m_bbox.getSurfaceArea();
+
+        bvh.m_nodes.clear();
+        bvh.m_indices.clear();
+        bvh.m_nodes.reserve(2 * size);
+        bvh.m_indices.reserve(size);
+
+        build_node(refs, 0);
+    }
+
+private:
+    /// Reference to a (possibly clipped) triangle
+    struct Reference {
+        uint32_t index;
+        BoundingBox3f bbox;
+    };
+
+    /// Candidate split plane
+    struct Split {
+        float cost = std::numeric_limits<float>::infinity();
+        int axis;
+        float pos;                  ///< Spatial splits: position of the plane
+        int index;                  ///< Object splits: last bin on the left side
+        float min, inv_bin_size;    ///< Object splits: centroid binning
+        uint32_t left_count, right_count;
+        BoundingBox3f bbox_left, bbox_right;
+    };
+
+    /// Surface area that treats empty bounding boxes as zero
+    static float area(const BoundingBox3f &bbox) {
+        return bbox.isValid() ? bbox.getSurfaceArea() : 0.0f;
+    }
+
+    float sah_cost(const BoundingBox3f &bbox, uint32_t left_count, float left_area,
+                   uint32_t right_count, float right_area) const {
+        return 2.0f * BVHBuildTask::TRAVERSAL_COST +
+            (float) BVHBuildTask::INTERSECTION_COST / bbox.getSurfaceArea() *
+            (left_count * left_area + right_count * right_area);
+    }
+
+    uint32_t build_node(std::vector<Reference> &refs, int depth) {
+        uint32_t node_idx = (uint32_t) bvh.m_nodes.size();
+        bvh.m_nodes.emplace_back();
+        bvh.m_nodes[node_idx].data = 0;
+
+        BoundingBox3f bbox, centroid_bbox;
+        for (const Reference &ref : refs) {
+            bbox.expandBy(ref.bbox);
+            centroid_bbox.expandBy(ref.bbox.getCenter());
+        }
+        bvh.m_nodes[node_idx].bbox = bbox;
+
+        uint32_t size = (uint32_t) refs.size();
+        if (size == 1 || depth >= MAX_DEPTH)
+            return make_leaf(node_idx, refs);
+
+        Split object, spatial;
+        find_object_split(refs, bbox, centroid_bbox, object);
+
+        /* Spatial splits only pay off when the children of the
+           object split overlap significantly */
+        BoundingBox3f overlap = bbox;
+        if (object.cost < std::numeric_limits<float>::infinity()) {
+            overlap = object.bbox_left;
+            overlap.clip(object.bbox_right);
+        }
+        if (m_refCount < m_maxRefs && area(overlap) > SPATIAL_SPLIT_ALPHA * m_rootArea)
+            find_spatial_split(refs, bbox, spatial);
+
+        float leaf_cost = (float) BVHBuildTask::INTERSECTION_COST * size;
+        std::vector<Reference> left, right;
+        int axis;
+
+        if (spatial.cost < object.cost && spatial.cost < leaf_cost &&
+            m_refCount + spatial.left_count + spatial.right_count - size <= m_maxRefs) {
+            perform_spatial_split(refs, spatial, left, right);
+            axis = spatial.axis;
+        }
+
+        if (left.empty() || right.empty()) {
+            if (!(object.cost < leaf_cost))
+                return make_leaf(node_idx, refs);
+            left.clear(); right.clear();
+            for (const Reference &ref : refs) {
+                int index = (int) ((ref.bbox.getCenter()[object.axis] - object.min) * object.inv_bin_size);
+                (index <= object.index ? left : right).push_back(ref);
+            }
+            axis = object.axis;
+        }
+
+        m_refCount += left.size() + right.size() - size;
+        std::vector<Reference>().swap(refs);
+
+        bvh.m_nodes[node_idx].inner.axis = axis;
+        bvh.m_nodes[node_idx].inner.flag = 0;
+        build_node(left, depth + 1);
+        uint32_t right_idx = build_node(right, depth + 1);
+        bvh.m_nodes[node_idx].inner.rightChild = right_idx;
+
+        return node_idx;
+    }
+
+    uint32_t make_leaf(uint32_t node_idx, const std::vector<Reference> &refs) {
+        Accel::BVHNode &node = bvh.m_nodes[node_idx];
+        node.leaf.flag = 1;
+        node.leaf.start = (uint32_t) bvh.m_indices.size();
+        node.leaf.size = (uint32_t) refs.size();
+        for (const Reference &ref : refs)
+            bvh.m_indices.push_back(ref.index);
+        return node_idx;
+    }
+
+    /// Binned SAH evaluation of object splits along all three axes
+    void find_object_split(const std::vector<Reference> &refs, const BoundingBox3f &bbox,
+                           const BoundingBox3f &centroid_bbox, Split &split) const {
+        const int bin_count = bvh.m_binCount;
+        uint32_t size = (uint32_t) refs.size();
+
+        for (int axis=0; axis<3; ++axis) {
+            float min = centroid_bbox.min[axis],
+                  extent = centroid_bbox.max[axis] - min;
+            if (!(extent > 0))
+                continue;
+            float inv_bin_size = bin_count / extent;
+
+            uint32_t counts[Bins::MAX_BIN_COUNT];
+            BoundingBox3f bins[Bins::MAX_BIN_COUNT], bbox_left[Bins::MAX_BIN_COUNT];
+            memset(counts, 0, sizeof(uint32_t) * bin_count);
+            for (const Reference &ref : refs) {
+                int index = std::min(std::max((int) ((ref.bbox.getCenter()[axis] - min)
+                    * inv_bin_size), 0), bin_count - 1);
+                counts[index]++;
+                bins[index].expandBy(ref.bbox);
+            }
+
+            bbox_left[0] = bins[0];
+            for (int i=1; i<bin_count; ++i) {
+                counts[i] += counts[i-1];
+                bbox_left[i] = BoundingBox3f::merge(bbox_left[i-1], bins[i]);
+            }
+
+            BoundingBox3f bbox_right = bins[bin_count-1];
+            for (int i=bin_count-2; i >= 0; --i) {
+                uint32_t left_count = counts[i], right_count = size - counts[i];
+                if (left_count > 0 && right_count > 0) {
+                    float cost = sah_cost(bbox, left_count, area(bbox_left[i]),
+                                          right_count, area(bbox_right));
+                    if (cost < split.cost) {
+                        split.cost = cost;
+                        split.axis = axis;
+                        split.index = i;
+                        split.min = min;
+                        split.inv_bin_size = inv_bin_size;
+                        split.left_count = left_count;
+                        split.right_count = right_count;
+                        split.bbox_left = bbox_left[i];
+                        split.bbox_right = bbox_right;
+                    }
+                }
+                bbox_right.expandBy(bins[i]);
+            }
+        }
+    }
+
+    /// Binned SAH evaluation of spatial splits along all three axes
+    void find_spatial_split(const std::vector<Reference> &refs, const BoundingBox3f &bbox,
+                            Split &split) const {
+        const int bin_count = bvh.m_binCount;
+
+        for (int axis=0; axis<3; ++axis) {
+            float origin = bbox.min[axis],
+                  bin_size = (bbox.max[axis] - origin) / bin_count;
+            if (!(bin_size > 0))
+                continue;
+            float inv_bin_size = 1.0f / bin_size;
+
+            uint32_t entry[Bins::MAX_BIN_COUNT], exit[Bins::MAX_BIN_COUNT];
+            BoundingBox3f bins[Bins::MAX_BIN_COUNT], bbox_right[Bins::MAX_BIN_COUNT];
+            memset(entry, 0, sizeof(uint32_t) * bin_count);
+            memset(exit, 0, sizeof(uint32_t) * bin_count);
+
+            /* Chop each reference into the bins that it overlaps */
+            for (const Reference &ref : refs) {
+                int first = std::min(std::max((int) ((ref.bbox.min[axis] - origin)
+                    * inv_bin_size), 0), bin_count - 1);
+                int last = std::min(std::max((int) ((ref.bbox.max[axis] - origin)
+                    * inv_bin_size), first), bin_count - 1);
+
+                Reference current = ref;
+                for (int i=first; i<last; ++i) {
+                    Reference left, right;
+                    split_reference(current, axis, origin + bin_size * (i+1), left, right);
+                    bins[i].expandBy(left.bbox);
+                    current = right;
+                }
+                bins[last].expandBy(current.bbox);
+                entry[first]++;
+                exit[last]++;
+            }
+
+            /* Sweep over the planes between the bins */
+            bbox_right[bin_count-1] = bins[bin_count-1];
+            for (int i=bin_count-2; i>=0; --i) {
+                bbox_right[i] = BoundingBox3f::merge(bbox_right[i+1], bins[i]);
+                exit[i] += exit[i+1];
+            }
+
+            BoundingBox3f bbox_left;
+            uint32_t left_count = 0;
+            for (int i=0; i<bin_count-1; ++i) {
+                bbox_left.expandBy(bins[i]);
+                left_count += entry[i];
+                uint32_t right_count = exit[i+1];
+                if (left_count == 0 || right_count == 0)
+                    continue;
+
+                float cost = sah_cost(bbox, left_count, area(bbox_left),
+                                      right_count, area(bbox_right[i+1]));
+                if (cost < split.cost) {
+                    split.cost = cost;
+                    split.axis = axis;
+                    split.pos = origin + bin_size * (i+1);
+                    split.left_count = left_count;
+                    split.right_count = right_count;
+                    split.bbox_left = bbox_left;
+                    split.bbox_right = bbox_right[i+1];
+                }
+            }
+        }
+    }
+
+    /**
+     * \brief Distribute the references among the children of a spatial
+     * split
+     *
+     * A reference straddling the split plane is either duplicated or moved
+     * entirely to one side ("unsplit"), whichever yields the lowest SAH cost
+     */
+    void perform_spatial_split(const std::vector<Reference> &refs, const Split &split,
+                               std::vector<Reference> &left, std::vector<Reference> &right) const {
+        std::vector<const Reference *> straddling;
+        BoundingBox3f bbox_left, bbox_right;
+
+        for (const Reference &ref : refs) {
+            if (ref.bbox.max[split.axis] <= split.pos) {
+                left.push_back(ref);
+                bbox_left.expandBy(ref.bbox);
+            } else if (ref.bbox.min[split.axis] >= split.pos) {
+                right.push_back(ref);
+                bbox_right.expandBy(ref.bbox);
+            } else {
+                straddling.push_back(&ref);
+            }
+        }
+
+        for (const Reference *ref : straddling) {
+            Reference ref_left, ref_right;
+            split_reference(*ref, split.axis, split.pos, ref_left, ref_right);
+
+            BoundingBox3f unsplit_left  = BoundingBox3f::merge(bbox_left, ref->bbox),
+                          unsplit_right = BoundingBox3f::merge(bbox_right, ref->bbox),
+                          dup_left  = BoundingBox3f::merge(bbox_left, ref_left.bbox),
+                          dup_right = BoundingBox3f::merge(bbox_right, ref_right.bbox);
+
+            float n_left = (float) left.size(), n_right = (float) right.size();
+            float cost_unsplit_left  = area(unsplit_left) * (n_left + 1) + area(bbox_right) * n_right;
+            float cost_unsplit_right = area(bbox_left) * n_left + area(unsplit_right) * (n_right + 1);
+            float cost_duplicate     = area(dup_left) * (n_left + 1) + area(dup_right) * (n_right + 1);
+
+            if (cost_unsplit_left <= cost_unsplit_right && cost_unsplit_left <= cost_duplicate) {
+                left.push_back(*ref);
+                bbox_left = unsplit_left;
+            } else if (cost_unsplit_right <= cost_duplicate) {
+                right.push_back(*ref);
+                bbox_right = unsplit_right;
+            } else {
+                left.push_back(ref_left);
+                right.push_back(ref_right);
+                bbox_left = dup_left;
+                bbox_right = dup_right;
+            }
+        }
+    }
+
+    /// Clip a triangle reference against an axis-aligned plane
+    void split_reference(const Reference &ref, int axis, float pos,
+                         Reference &left, Reference &right) const {
+        uint32_t idx = ref.index;
+        const Mesh *mesh = bvh.m_meshes[bvh.findMesh(idx)];
+
+        left.index = right.index = ref.index;
+        left.bbox.reset();
+        right.bbox.reset();
+
+        for (int i=0; i<3; ++i) {
+            Point3f v0 = mesh->getVertexPosition(mesh->getVertexIndex(idx, i), 0.f),
+                    v1 = mesh->getVertexPosition(mesh->getVertexIndex(idx, (i+1) % 3), 0.f);
+            float p0 = v0[axis], p1 = v1[axis];
+
+            if (p0 <= pos)
+                left.bbox.expandBy(v0);
+            if (p0 >= pos)
+                right.bbox.expandBy(v0);
+
+            /* Edge crossing the plane: both sides receive the intersection */
+            if ((p0 < pos && p1 > pos) || (p0 > pos && p1 < pos)) {
+                Point3f p = v0 + (v1 - v0) * std::min(std::max((pos - p0) / (p1 - p0), 0.0f), 1.0f);
+                p[axis] = pos;
+                left.bbox.expandBy(p);
+                right.bbox.expandBy(p);
+            }
+        }
+
+        left.bbox.max[axis] = pos;
+        right.bbox.min[axis] = pos;
+        left.bbox.clip(ref.bbox);
+        right.bbox.clip(ref.bbox);
+    }
+
+private:
+    /// Only consider spatial splits when the object split children overlap
+    /// by more than this fraction of the surface area of the root node
+    static constexpr float SPATIAL_SPLIT_ALPHA = 1e-5f;
+
+    Accel &bvh;
+    uint64_t m_refCount;  ///< Number of references in the tree under construction
+    uint64_t m_maxRefs;   ///< Memory budget (maximum number of references)
+    float m_rootArea;
+};
+
+Accel::Accel(const PropertyList &propList) : m_propList(propList) {
+    m_meshOffset.push_back(0u);
+
+    /* Collapse into a wide BVH after construction? */
+    m_quantized = propList.getBoolean("quantizedBVH", false);
+    m_wide = propList.getBoolean("wideBVH", false) || m_quantized;
+
+    /* Visit the near child first during traversal? */
+    m_ordered = propList.getBoolean("orderedTraversal", true);
+
+    /* Trade-off between build time and tree quality */
+    std::string preset = propList.getString("bvhPreset", "balanced");
+    if (preset == "fast") {
+        m_binCount = 8;
+        m_fullSweep = false;
+    } else if (preset == "balanced") {
+        m_binCount = 32;
+        m_fullSweep = false;
+    } else if (preset == "high-quality") {
+        m_binCount = Bins::MAX_BIN_COUNT;
+        m_fullSweep = true;
+    } else {
+        throw NoriException("Accel: unknown BVH preset \"%s\" (must be "
+            "\"fast\", \"balanced\", or \"high-quality\")", preset);
+    }
+
+    /* Build a spatial split BVH? */
+    m_spatialSplits = propList.getBoolean("spatialSplits", false);
+    m_spatialSplitBudget = propList.getFloat("spatialSplitBudget", 0.5f);
+    if (m_spatialSplitBudget < 0)
+        throw NoriException("Accel: the spatial split budget must be nonnegative!");
+
+    /* Optional file for caching the BVH between runs */
+    m_cacheFilename = propList.getString("bvhCache", "");
+
+    /* Relative increase of the SAH cost that makes refit() rebuild the tree */
+    m_rebuildThreshold = propList.getFloat("rebuildThreshold", 1.5f);
+
+    /* Keep a leaf-ordered copy of the triangles? (see addMesh()) */
+    m_precomputeDefault = !propList.has("precomputeTriangles");
+    m_precompute = propList.getBoolean("precomputeTriangles", true);
+
+    /* Use the vectorized leaf kernel if supported by the processor */
+    std::string isa;
+    m_packIntersect = getTrianglePackIntersector(isa);
+    if (!m_packIntersect && isa != "none")
+        cerr << "Warning: the processor does not support " << isa
+             << ", falling back to scalar triangle intersection." << endl;
+}
+
 void Accel::addMesh(Mesh *mesh) {
+    /* A full-precision copy would undo the savings of compressed
+       and memory-mapped meshes */
+    if (m_precomputeDefault && (mesh->isCompressed() || mesh->isMemoryMapped()))
+        m_precompute = false;
+
     m_meshes.push_back(mesh);
     m_meshOffset.push_back(m_meshOffset.back() + mesh->getTriangleCount());
     m_bbox.expandBy(mesh->getBoundingBox());
 }
 
+void Accel::addInstance(const Instance *instance) {
+    m_instances.push_back(instance);
+}
+
 void Accel::clear() {
     for (auto mesh : m_meshes)
         delete mesh;
+    for (auto accel : m_meshAccels)
+        delete accel;
+    delete m_motionAccel;
+    m_motionAccel = nullptr;
     m_meshes.clear();
+    m_meshAccels.clear();
+    m_instances.clear();
+    m_instanceAccels.clear();
+    m_instanceNodes.clear();
+    m_instanceIndices.clear();
     m_meshOffset.clear();
     m_meshOffset.push_back(0u);
     m_nodes.clear();
     m_indices.clear();
+    m_triangles.clear();
+    m_packs.clear();
+    m_packOffset.clear();
+    m_wideNodes.clear();
+    m_quantNodes.clear();
+    m_nodeBoundsEnd.clear();
     m_bbox.reset();
+    if (m_precomputeDefault)
+        m_precompute = true;
     m_nodes.shrink_to_fit();
     m_meshes.shrink_to_fit();
     m_meshOffset.shrink_to_fit();
     m_indices.shrink_to_fit();
+    m_triangles.shrink_to_fit();
+    m_packs.shrink_to_fit();
+    m_packOffset.shrink_to_fit();
+    m_wideNodes.shrink_to_fit();
+    m_quantNodes.shrink_to_fit();
+    m_nodeBoundsEnd.shrink_to_fit();
 }
 
 void Accel::build() {
+    if (!m_instances.empty())
+        buildInstances();
+    if (!m_motion)
+        buildMotion();
+
     uint32_t size  = getTriangleCount();
-    if (size == 0)
+    if (size == 0) {
+        updateBoundingBox();
         return;
-    cout << "Constructing a SAH BVH (" << m_meshes.size()
-        << (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
-        << size << " triangles) .. ";
-    cout.flush();
-    Timer timer;
-
-    /* Conservative estimate for the total number of nodes */
-    m_nodes.resize(2*size);
-    memset(m_nodes.data(), 0, sizeof(BVHNode) * m_nodes.size());
-    m_nodes[0].bbox = m_bbox;
-    m_indices.resize(size);
+    }
 
     if (sizeof(BVHNode) != 32)
         throw NoriException("BVH Node is not packed! Investigate compiler settings.");
 
-    for (uint32_t i = 0; i < size; ++i)
-        m_indices[i] = i;
+    Timer timer;
+    uint64_t cacheKey = 0;
+    bool cached = false;
+    if (!m_cacheFilename.empty()) {
+        cacheKey = getCacheKey();
+        cached = readCache(cacheKey);
+    }
+
+    std::pair<float, uint32_t> stats;
+    if (cached) {
+        cout << "Loading cached SAH BVH (" << m_meshes.size()
+            << (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
+            << size << " triangles) .. ";
+        cout.flush();
+        stats = statistics();
+    } else {
+        cout << "Constructing a " << (m_motion ? "motion" : "SAH") << " BVH (" << m_meshes.size()
+            << (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
+            << size << " triangles) .. ";
+        cout.flush();
+        stats = buildTree();
+    }
 
-    uint32_t *indices = m_indices.data(), *temp = new uint32_t[size];
-    BVHBuildTask& task = *new(tbb::task::allocate_root())
-        BVHBuildTask(*this, 0u, indices, indices + size , temp);
-    tbb::task::spawn_root_and_wait(task);
-    delete[] temp;
-    std::pair<float, uint32_t> stats = statistics();
+    if (m_motion)
+        updateMotionBounds();
+    else
+        precomputeTriangles();
+
+    cout << "done (took " << timer.elapsedString() << " and "
+        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size() +
+                     sizeof(BoundingBox3f) * m_nodeBoundsEnd.size() +
+                     sizeof(PrecomputedTriangle) * m_triangles.size() +
+                     sizeof(TrianglePack) * m_packs.size() +
+                     sizeof(uint32_t) * m_packOffset.size())
+        << ", SAH cost = " << stats.first;
+    if (m_spatialSplits)
+        cout << ", " << m_indices.size() << " references";
+    cout << ")." << endl;
+
+    if (!m_cacheFilename.empty() && !cached)
+        writeCache(cacheKey);
+
+    m_sahCost = stats.first;
+
+    /* The triangle BVH was built using the bounds of the static triangles only */
+    updateBoundingBox();
+
+    if (m_wide)
+        collapse();
+}
 
-    /* The node array was allocated conservatively and now contains
-       many unused entries -- do a compactification pass. */
-    std::vector<BVHNode> compactified(stats.second);
-    std::vector<uint32_t> skipped_accum(m_nodes.size());
+void Accel::buildInstances() {
+    /* Move the referenced meshes into separate BVHs (which own them) */
+    std::map<const Mesh *, Accel *> meshAccels;
+    for (auto instance : m_instances)
+        meshAccels[instance->getMesh()] = nullptr;
 
-    for (int64_t i = stats.second-1, j = m_nodes.size(), skipped = 0; i >= 0; --i) {
-        while (m_nodes[--j].isUnused())
-            skipped++;
-        BVHNode &new_node = compactified[i];
-        new_node = m_nodes[j];
-        skipped_accum[j] = (uint32_t) skipped;
+    std::vector<Mesh *> meshes;
+    meshes.swap(m_meshes);
+    m_meshOffset.clear();
+    m_meshOffset.push_back(0u);
+    m_bbox.reset();
 
-        if (new_node.isInner()) {
-            new_node.inner.rightChild = (uint32_t)
-                (i + new_node.inner.rightChild - j -
-                (skipped - skipped_accum[new_node.inner.rightChild]));
+    for (auto mesh : meshes) {
+        auto it = meshAccels.find(mesh);
+        if (it == meshAccels.end()) {
+            addMesh(mesh);
+            continue;
         }
+        Accel *accel = new Accel(m_propList);
+        accel->m_cacheFilename.clear();
+        accel->addMesh(mesh);
+        accel->build();
+        m_meshAccels.push_back(accel);
+        it->second = accel;
+    }
+
+    m_instanceAccels.resize(m_instances.size());
+    for (size_t i = 0; i < m_instances.size(); ++i) {
+        const Accel *accel = meshAccels[m_instances[i]->getMesh()];
+        if (!accel)
+            throw NoriException("Accel: instanced mesh \"%s\" was not "
+                "added to the scene!", m_instances[i]->getMesh()->getName());
+        m_instanceAccels[i] = accel;
     }
+
+    cout << "Constructing the top-level BVH (" << m_instances.size()
+        << (m_instances.size() == 1 ? " instance of " : " instances of ")
+        << m_meshAccels.size() << (m_meshAccels.size() == 1 ? " mesh) .. " : " meshes) .. ");
+    cout.flush();
+    Timer timer;
+
+    buildTopLevel();
+
     cout << "done (took " << timer.elapsedString() << " and "
-        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size())
-        << ", SAH cost = " << stats.first
+        << memString(sizeof(BVHNode) * m_instanceNodes.size() +
+                     sizeof(uint32_t) * m_instanceIndices.size())
         << ")." << endl;
+}
+
+void Accel::buildMotion() {
+    bool motion = false;
+    for (auto mesh : m_meshes)
+        motion |= mesh->hasMotion();
+    if (!motion)
+        return;
 
-    m_nodes = std::move(compactified);
+    /* Move the moving meshes into a separate BVH (which owns them) */
+    std::vector<Mesh *> meshes;
+    meshes.swap(m_meshes);
+    m_meshOffset.clear();
+    m_meshOffset.push_back(0u);
+    m_bbox.reset();
+
+    Accel *accel = new Accel(m_propList);
+    accel->m_motion = true;
+    accel->m_wide = false;
+    accel->m_spatialSplits = false;
+    accel->m_cacheFilename.clear();
+
+    for (auto mesh : meshes) {
+        if (mesh->hasMotion())
+            accel->addMesh(mesh);
+        else
+            addMesh(mesh);
+    }
+
+    accel->build();
+    m_motionAccel = accel;
 }
 
-std::pair<float, uint32_t> Accel::statistics(uint32_t node_idx) const {
-    const BVHNode &node = m_nodes[node_idx];
-    if (node.isLeaf()) {
-        return std::make_pair((float) BVHBuildTask::INTERSECTION_COST * node.leaf.size, 1u);
-    } else {
-        std::pair<float, uint32_t> stats_left = statistics(node_idx + 1u);
-        std::pair<float, uint32_t> stats_right = statistics(node.inner.rightChild);
-        float saLeft = m_nodes[node_idx + 1u].bbox.getSurfaceArea();
-        float saRight = m_nodes[node.inner.rightChild].bbox.getSurfaceArea();
-        float saCur = node.bbox.getSurfaceArea();
-        float sahCost =
-            2 * BVHBuildTask::TRAVERSAL_COST +
-            (saLeft * stats_left.first + saRight * stats_right.first) / saCur;
-        return std::make_pair(
-            sahCost,
-            stats_left.second + stats_right.second + 1u
-        );
+void Accel::updateMotionBounds() {
+    /* Children are stored after their parents -- update the
+       bounds in reverse order so that they are ready when needed.
+       Since the vertices move linearly, the bounds interpolated
+       between both ends contain the triangles at any time. */
+    m_nodeBoundsEnd.resize(m_nodes.size());
+    for (int64_t i = (int64_t) m_nodes.size() - 1; i >= 0; --i) {
+        BVHNode &node = m_nodes[i];
+        BoundingBox3f &bboxEnd = m_nodeBoundsEnd[i];
+        if (node.isLeaf()) {
+            node.bbox.reset();
+            bboxEnd.reset();
+            for (uint32_t j = node.start(), end = node.end(); j < end; ++j) {
+                uint32_t idx = m_indices[j];
+                const Mesh *mesh = m_meshes[findMesh(idx)];
+                for (int k = 0; k < 3; ++k) {
+                    uint32_t vertex = mesh->getVertexIndex(idx, k);
+                    node.bbox.expandBy(mesh->getVertexPosition(vertex, 0.f));
+                    bboxEnd.expandBy(mesh->getVertexPosition(vertex, 1.f));
+                }
+            }
+        } else {
+            node.bbox = m_nodes[i + 1].bbox;
+            node.bbox.expandBy(m_nodes[node.inner.rightChild].bbox);
+            bboxEnd = m_nodeBoundsEnd[i + 1];
+            bboxEnd.expandBy(m_nodeBoundsEnd[node.inner.rightChild]);
+        }
     }
 }
 
-bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
-    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+void Accel::updateBoundingBox() {
+    m_bbox.reset();
+    for (auto mesh : m_meshes)
+        m_bbox.expandBy(mesh->getBoundingBox());
+    if (!m_instanceNodes.empty())
+        m_bbox.expandBy(m_instanceNodes[0].bbox);
+    if (m_motionAccel)
+        m_bbox.expandBy(m_motionAccel->getBoundingBox());
+}
 
-    its.t = std::numeric_limits<float>::infinity();
+void Accel::buildTopLevel() {
+    std::vector<BoundingBox3f> bounds(m_instances.size());
+    for (size_t i = 0; i < m_instances.size(); ++i)
+        bounds[i] = m_instances[i]->getBoundingBox();
 
-    /* Use an adaptive ray epsilon */
-    Ray3f ray(_ray);
-    if (ray.mint == Epsilon)
-        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+    m_instanceIndices.resize(m_instances.size());
+    for (uint32_t i = 0; i < (uint32_t) m_instances.size(); ++i)
+        m_instanceIndices[i] = i;
 
-    if (m_nodes.empty() || ray.maxt < ray.mint)
-        return false;
+    m_instanceNodes.clear();
+    m_instanceNodes.reserve(2 * m_instances.size());
+    buildInstanceTree(bounds.data(), m_instanceIndices.data(),
+                      m_instanceIndices.data() + m_instanceIndices.size());
+    m_instanceNodes.shrink_to_fit();
+}
+
+void Accel::buildInstanceTree(const BoundingBox3f *bounds, uint32_t *start, uint32_t *end) {
+    const int BinCount = 16;
+    uint32_t node_idx = (uint32_t) m_instanceNodes.size();
+    uint32_t size = (uint32_t) (end - start);
+    m_instanceNodes.emplace_back();
+
+    BoundingBox3f bbox, centroids;
+    for (uint32_t *it = start; it != end; ++it) {
+        const BoundingBox3f &b = bounds[*it];
+        bbox.expandBy(b);
+        centroids.expandBy(b.getCenter());
+    }
+    m_instanceNodes[node_idx].bbox = bbox;
+
+    int axis = centroids.getMajorAxis();
+    float minValue = centroids.min[axis], extent = centroids.max[axis] - minValue;
+
+    if (size == 1 || extent == 0) {
+        BVHNode &node = m_instanceNodes[node_idx];
+        node.leaf.flag = 1;
+        node.leaf.start = (uint32_t) (start - m_instanceIndices.data());
+        node.leaf.size = size;
+        return;
+    }
+
+    /* Binned SAH split along the axis with the largest centroid extent */
+    auto getBin = [&](uint32_t idx) {
+        float value = bounds[idx].getCenter()[axis];
+        return std::min((int) ((value - minValue) * (BinCount / extent)), BinCount - 1);
+    };
+
+    BoundingBox3f binBBox[BinCount];
+    uint32_t binCount[BinCount] = { 0 };
+    for (uint32_t *it = start; it != end; ++it) {
+        int bin = getBin(*it);
+        binBBox[bin].expandBy(bounds[*it]);
+        binCount[bin]++;
+    }
+
+    float rightArea[BinCount];
+    BoundingBox3f accum;
+    for (int i = BinCount - 1; i > 0; --i) {
+        accum.expandBy(binBBox[i]);
+        rightArea[i] = accum.isValid() ? accum.getSurfaceArea() : 0.f;
+    }
+
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestSplit = 0;
+    uint32_t leftCount = 0;
+    accum.reset();
+    for (int i = 0; i < BinCount - 1; ++i) {
+        accum.expandBy(binBBox[i]);
+        leftCount += binCount[i];
+        if (leftCount == 0 || leftCount == size)
+            continue;
+        float cost = leftCount * accum.getSurfaceArea() +
+                     (size - leftCount) * rightArea[i + 1];
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestSplit = i;
+        }
+    }
+
+    uint32_t *mid = std::partition(start, end,
+        [&](uint32_t idx) { return getBin(idx) <= bestSplit; });
+
+    buildInstanceTree(bounds, start, mid);
+    uint32_t node_idx_right = (uint32_t) m_instanceNodes.size();
+    buildInstanceTree(bounds, mid, end);
+
+    BVHNode &node = m_instanceNodes[node_idx];
+    node.inner.flag = 0;
+    node.inner.axis = axis;
+    node.inner.rightChild = node_idx_right;
+}
+
+std::pair<float, uint32_t> Accel::buildTree() {
+    uint32_t size  = getTriangleCount();
+    std::pair<float, uint32_t> stats;
+
+    if (m_spatialSplits) {
+        /* Serial build, which directly produces a compact node array */
+        SBVHBuilder(*this).build();
+        m_nodes.shrink_to_fit();
+        m_indices.shrink_to_fit();
+        stats = statistics();
+    } else {
+        /* Conservative estimate for the total number of nodes */
+        m_nodes.resize(2*size);
+        memset(m_nodes.data(), 0, sizeof(BVHNode) * m_nodes.size());
+        m_nodes[0].bbox = m_bbox;
+        m_indices.resize(size);
+
+        for (uint32_t i = 0; i < size; ++i)
+            m_indices[i] = i;
+
+        uint32_t *indices = m_indices.data(), *temp = new uint32_t[size];
+        BVHBuildTask& task = *new(tbb::task::allocate_root())
+            BVHBuildTask(*this, 0u, indices, indices + size , temp);
+        tbb::task::spawn_root_and_wait(task);
+        delete[] temp;
+        stats = statistics();
+
+        /* The node array was allocated conservatively and now contains
+           many unused entries -- do a compactification pass. */
+        std::vector<BVHNode> compactified(stats.second);
+        std::vector<uint32_t> skipped_accum(m_nodes.size());
+
+        for (int64_t i = stats.second-1, j = m_nodes.size(), skipped = 0; i >= 0; --i) {
+            while (m_nodes[--j].isUnused())
+                skipped++;
+            BVHNode &new_node = compactified[i];
+            new_node = m_nodes[j];
+            skipped_accum[j] = (uint32_t) skipped;
+
+            if (new_node.isInner()) {
+                new_node.inner.rightChild = (uint32_t)
+                    (i + new_node.inner.rightChild - j -
+                    (skipped - skipped_accum[new_node.inner.rightChild]));
+            }
+        }
+        m_nodes = std::move(compactified);
+    }
+
+    updateOcclusionOrder();
+
+    return stats;
+}
+
+void Accel::updateOcclusionOrder() {
+    /* Occlusion queries first visit the child with the larger surface area */
+    for (uint32_t i = 0; i < (uint32_t) m_nodes.size(); ++i) {
+        BVHNode &node = m_nodes[i];
+        if (node.isInner())
+            node.inner.rightFirst =
+                m_nodes[node.inner.rightChild].bbox.getSurfaceArea() >
+                m_nodes[i + 1].bbox.getSurfaceArea();
+    }
+}
+
+bool Accel::refit() {
+    bool rebuilt = false;
+
+    for (auto accel : m_meshAccels)
+        rebuilt |= accel->refit();
+    if (m_motionAccel)
+        rebuilt |= m_motionAccel->refit();
+
+    m_bbox.reset();
+    for (auto mesh : m_meshes)
+        m_bbox.expandBy(mesh->getBoundingBox());
+
+    if (!m_nodes.empty()) {
+        cout << "Refitting the SAH BVH (" << m_meshes.size()
+            << (m_meshes.size() == 1 ? " mesh, " : " meshes, ")
+            << getTriangleCount() << " triangles) .. ";
+        cout.flush();
+        Timer timer;
+
+        /* Children are stored after their parents -- update the
+           bounds in reverse order so that they are ready when needed */
+        for (int64_t i = (int64_t) m_nodes.size() - 1; i >= 0; --i) {
+            BVHNode &node = m_nodes[i];
+            if (node.isLeaf()) {
+                node.bbox.reset();
+                for (uint32_t j = node.start(), end = node.end(); j < end; ++j)
+                    node.bbox.expandBy(getBoundingBox(m_indices[j]));
+            } else {
+                node.bbox = m_nodes[i + 1].bbox;
+                node.bbox.expandBy(m_nodes[node.inner.rightChild].bbox);
+            }
+        }
+
+        /* Rebuild when the tree quality degraded too much */
+        float sahCost = statistics().first;
+        if (m_rebuildThreshold > 0 && sahCost > m_rebuildThreshold * m_sahCost) {
+            cout << "SAH cost " << m_sahCost << " -> " << sahCost << ", rebuilding .. ";
+            cout.flush();
+            sahCost = buildTree().first;
+            m_sahCost = sahCost;
+            rebuilt = true;
+        } else {
+            updateOcclusionOrder();
+        }
+
+        if (m_motion)
+            updateMotionBounds();
+        else
+            precomputeTriangles();
+
+        cout << "done (took " << timer.elapsedString() << ", SAH cost = "
+             << sahCost << ")." << endl;
+
+        if (m_wide)
+            collapse();
+    }
+
+    updateInstances();
+
+    return rebuilt;
+}
+
+void Accel::updateInstances() {
+    if (!m_instances.empty())
+        buildTopLevel();
+
+    updateBoundingBox();
+}
+
+/// Header of BVH cache files
+struct BVHCacheHeader {
+    char magic[8];        ///< "NORIBVH" (null-terminated)
+    uint32_t version;     ///< File format version (\ref Accel::CacheVersion)
+    uint32_t nodeSize;    ///< sizeof(BVHNode) of the writer
+    uint64_t key;         ///< Hash of the meshes and build parameters
+    uint64_t nodeCount;   ///< Number of entries in the node array
+    uint64_t indexCount;  ///< Number of entries in the index array
+    uint64_t checksum;    ///< Hash of the node and index arrays
+};
+
+/// Incrementally compute a 64-bit FNV-1a hash
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *ptr = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= ptr[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t Accel::getCacheKey() const {
+    uint64_t hash = 14695981039346656037ull;
+
+    /* Build parameters that affect the tree */
+    uint32_t version = CacheVersion, nodeSize = (uint32_t) sizeof(BVHNode);
+    int32_t binCount = m_binCount;
+    uint8_t flags = (m_fullSweep ? 1 : 0) | (m_spatialSplits ? 2 : 0);
+    hash = fnv1a(hash, &version, sizeof(uint32_t));
+    hash = fnv1a(hash, &nodeSize, sizeof(uint32_t));
+    hash = fnv1a(hash, &binCount, sizeof(int32_t));
+    hash = fnv1a(hash, &flags, sizeof(uint8_t));
+    if (m_spatialSplits)
+        hash = fnv1a(hash, &m_spatialSplitBudget, sizeof(float));
+
+    /* Geometry of all meshes (in the order they were added) */
+    uint32_t meshCount = (uint32_t) m_meshes.size();
+    hash = fnv1a(hash, &meshCount, sizeof(uint32_t));
+    for (const Mesh *mesh : m_meshes) {
+        uint64_t sizes[2] = { (uint64_t) mesh->getVertexCount(),
+                              (uint64_t) mesh->getTriangleCount() };
+        hash = fnv1a(hash, sizes, sizeof(sizes));
+
+        /* Compressed meshes are hashed by their decoded contents */
+        const MatrixXfView &V = mesh->getVertexPositions();
+        const MatrixXuView &F = mesh->getIndices();
+        if (mesh->isCompressed()) {
+            for (uint32_t i = 0; i < mesh->getVertexCount(); ++i) {
+                Point3f p = mesh->getVertexPosition(i, 0.f);
+                hash = fnv1a(hash, p.data(), sizeof(float) * 3);
+            }
+        } else {
+            hash = fnv1a(hash, V.data(), sizeof(float) * V.size());
+        }
+        if (F.size() == 0) {
+            for (uint32_t i = 0; i < mesh->getTriangleCount(); ++i) {
+                uint32_t idx[3] = { mesh->getVertexIndex(i, 0), mesh->getVertexIndex(i, 1),
+                                    mesh->getVertexIndex(i, 2) };
+                hash = fnv1a(hash, idx, sizeof(idx));
+            }
+        } else {
+            hash = fnv1a(hash, F.data(), sizeof(uint32_t) * F.size());
+        }
+    }
+
+    return hash;
+}
+
+/// Resolve the BVH cache filename (relative paths refer to the scene directory)
+static filesystem::path resolveCacheFilename(const std::string &filename) {
+    filesystem::path path = getFileResolver()->resolve(filename);
+    if (!path.exists() && !path.is_absolute() && getFileResolver()->size() > 0)
+        path = *getFileResolver()->begin() / path;
+    return path;
+}
+
+bool Accel::readCache(uint64_t key) {
+    filesystem::path path = resolveCacheFilename(m_cacheFilename);
+    std::ifstream is(path.str(), std::ios::binary);
+    if (is.fail())
+        return false;
+
+    BVHCacheHeader header;
+    is.read((char *) &header, sizeof(BVHCacheHeader));
+    if (is.fail() || strncmp(header.magic, "NORIBVH", sizeof(header.magic)) != 0 ||
+        header.version != CacheVersion || header.nodeSize != sizeof(BVHNode)) {
+        cerr << "Warning: ignoring invalid or outdated BVH cache \"" << path << "\"" << endl;
+        return false;
+    }
+
+    /* The scene or the build parameters changed since the cache was written */
+    if (header.key != key)
+        return false;
+
+    /* A tree over N triangle references has at most 2N-1 nodes. Check
+       this before allocating memory for the arrays of a corrupted file */
+    uint64_t size = getTriangleCount(), maxRefs = size;
+    if (m_spatialSplits)
+        maxRefs = (uint64_t) (size * (1.0 + m_spatialSplitBudget));
+    if (header.indexCount == 0 || header.indexCount > maxRefs ||
+        header.nodeCount == 0 || header.nodeCount > 2 * header.indexCount - 1) {
+        cerr << "Warning: ignoring corrupted BVH cache \"" << path << "\"" << endl;
+        return false;
+    }
+
+    m_nodes.resize((size_t) header.nodeCount);
+    m_indices.resize((size_t) header.indexCount);
+    is.read((char *) m_nodes.data(), sizeof(BVHNode) * m_nodes.size());
+    is.read((char *) m_indices.data(), sizeof(uint32_t) * m_indices.size());
+
+    if (is.fail()) {
+        cerr << "Warning: BVH cache \"" << path << "\" is truncated" << endl;
+        m_nodes.clear();
+        m_indices.clear();
+        return false;
+    }
+
+    uint64_t checksum = fnv1a(14695981039346656037ull, m_nodes.data(),
+                              sizeof(BVHNode) * m_nodes.size());
+    checksum = fnv1a(checksum, m_indices.data(), sizeof(uint32_t) * m_indices.size());
+
+    if (checksum != header.checksum || !isValidTree()) {
+        cerr << "Warning: ignoring corrupted BVH cache \"" << path << "\"" << endl;
+        m_nodes.clear();
+        m_indices.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool Accel::isValidTree() const {
+    uint32_t size = getTriangleCount(), nodeCount = (uint32_t) m_nodes.size();
+    uint64_t indexCount = m_indices.size();
+
+    for (uint32_t idx : m_indices) {
+        if (idx >= size)
+            return false;
+    }
+
+    /* Children are stored after their parent, and every node must be
+       reachable from the root exactly once. The traversal stacks have
+       room for 64 levels */
+    struct Entry {
+        uint32_t node;
+        uint32_t depth;
+    };
+    std::vector<Entry> stack;
+    std::vector<bool> visited(nodeCount, false);
+    uint32_t visitedCount = 0;
+    stack.push_back(Entry { 0u, 1u });
+
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+
+        if (visited[entry.node])
+            return false;
+        visited[entry.node] = true;
+        ++visitedCount;
+
+        const BVHNode &node = m_nodes[entry.node];
+        for (int k=0; k<3; ++k) {
+            if (!std::isfinite(node.bbox.min[k]) || !std::isfinite(node.bbox.max[k]) ||
+                node.bbox.min[k] > node.bbox.max[k])
+                return false;
+        }
+
+        if (node.isLeaf()) {
+            if ((uint64_t) node.leaf.start + node.leaf.size > indexCount)
+                return false;
+        } else {
+            uint32_t left = entry.node + 1, right = node.inner.rightChild;
+            if (entry.depth >= 64 || node.inner.axis > 2 ||
+                right <= left || right >= nodeCount)
+                return false;
+            stack.push_back(Entry { left, entry.depth + 1 });
+            stack.push_back(Entry { right, entry.depth + 1 });
+        }
+    }
+
+    return visitedCount == nodeCount;
+}
+
+void Accel::writeCache(uint64_t key) const {
+    filesystem::path path = resolveCacheFilename(m_cacheFilename);
+
+    BVHCacheHeader header;
+    memset(&header, 0, sizeof(BVHCacheHeader));
+    strcpy(header.magic, "NORIBVH");
+    header.version = CacheVersion;
+    header.nodeSize = (uint32_t) sizeof(BVHNode);
+    header.key = key;
+    header.nodeCount = m_nodes.size();
+    header.indexCount = m_indices.size();
+    header.checksum = fnv1a(14695981039346656037ull, m_nodes.data(),
+                            sizeof(BVHNode) * m_nodes.size());
+    header.checksum = fnv1a(header.checksum, m_indices.data(),
+                            sizeof(uint32_t) * m_indices.size());
+
+    /* Write to a temporary file first, which keeps concurrently
+       started renderers from reading an incomplete cache */
+    std::string tempFilename = tfm::format("%s.%08x.tmp", path.str(),
+                                           (uint32_t) std::random_device()());
+    std::ofstream os(tempFilename, std::ios::binary);
+    os.write((const char *) &header, sizeof(BVHCacheHeader));
+    os.write((const char *) m_nodes.data(), sizeof(BVHNode) * m_nodes.size());
+    os.write((const char *) m_indices.data(), sizeof(uint32_t) * m_indices.size());
+    os.close();
+
+    if (os.fail()) {
+        cerr << "Warning: could not write the BVH cache \"" << path << "\"" << endl;
+        std::remove(tempFilename.c_str());
+        return;
+    }
+
+    std::remove(path.str().c_str());
+    if (std::rename(tempFilename.c_str(), path.str().c_str()) != 0) {
+        cerr << "Warning: could not write the BVH cache \"" << path << "\"" << endl;
+        std::remove(tempFilename.c_str());
+        return;
+    }
+
+    cout << "Wrote the BVH to \"" << path << "\" for use by later runs." << endl;
+}
+
+void Accel::precomputeTriangles() {
+    if (!m_precompute)
+        return;
+
+    if (m_packIntersect) {
+        /* Assign a contiguous range of packs to every leaf */
+        const uint32_t W = TrianglePack::Size;
+        m_packOffset.resize(m_nodes.size());
+        uint32_t packCount = 0;
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            m_packOffset[i] = packCount;
+            if (m_nodes[i].isLeaf())
+                packCount += (m_nodes[i].leaf.size + W - 1) / W;
+        }
+        m_packs.clear();
+        m_packs.resize(packCount);
+
+        tbb::parallel_for(
+            tbb::blocked_range<uint32_t>(0u, (uint32_t) m_nodes.size()),
+            [&](const tbb::blocked_range<uint32_t> &range) {
+                for (uint32_t n = range.begin(); n != range.end(); ++n) {
+                    const BVHNode &node = m_nodes[n];
+                    if (!node.isLeaf())
+                        continue;
+                    for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+                        uint32_t idx = m_indices[i];
+                        uint32_t meshIdx = findMesh(idx);
+                        const Mesh *mesh = m_meshes[meshIdx];
+                        uint32_t k = i - node.start();
+
+                        m_packs[m_packOffset[n] + k / W].set(k % W,
+                            mesh->getVertexPosition(mesh->getVertexIndex(idx, 0), 0.f),
+                            mesh->getVertexPosition(mesh->getVertexIndex(idx, 1), 0.f),
+                            mesh->getVertexPosition(mesh->getVertexIndex(idx, 2), 0.f),
+                            meshIdx, idx);
+                    }
+                }
+            }
+        );
+        return;
+    }
+
+    m_triangles.resize(m_indices.size());
+
+    tbb::parallel_for(
+        tbb::blocked_range<uint32_t>(0u, (uint32_t) m_indices.size(), BVHBuildTask::GRAIN_SIZE),
+        [&](const tbb::blocked_range<uint32_t> &range) {
+            for (uint32_t i = range.begin(); i != range.end(); ++i) {
+                uint32_t idx = m_indices[i];
+                uint32_t meshIdx = findMesh(idx);
+                const Mesh *mesh = m_meshes[meshIdx];
+
+                const Point3f p0 = mesh->getVertexPosition(mesh->getVertexIndex(idx, 0), 0.f),
+                              p1 = mesh->getVertexPosition(mesh->getVertexIndex(idx, 1), 0.f),
+                              p2 = mesh->getVertexPosition(mesh->getVertexIndex(idx, 2), 0.f);
+
+                PrecomputedTriangle &tri = m_triangles[i];
+                tri.p0 = p0;
+                tri.e1 = p1 - p0;
+                tri.e2 = p2 - p0;
+                tri.mesh = meshIdx;
+                tri.index = idx;
+            }
+        }
+    );
+}
+
+void Accel::collapse() {
+    m_wideNodes.clear();
+    m_quantNodes.clear();
+    if (m_nodes.empty())
+        return;
+
+    cout << "Collapsing into a BVH" << NORI_BVH_WIDTH << " .. ";
+    cout.flush();
+    Timer timer;
+
+    if (m_nodes[0].isLeaf()) {
+        /* Degenerate case: the whole tree is a single leaf */
+        WideBVHNode node;
+        for (int i=0; i<3; ++i) {
+            node.min[i].setConstant(std::numeric_limits<float>::infinity());
+            node.max[i].setConstant(-std::numeric_limits<float>::infinity());
+            node.min[i][0] = m_nodes[0].bbox.min[i];
+            node.max[i][0] = m_nodes[0].bbox.max[i];
+        }
+        node.child[0] = WideBVHNode::LeafFlag;
+        node.count = 1;
+        m_wideNodes.push_back(node);
+    } else {
+        collapse(0u);
+    }
+
+    cout << "done (took " << timer.elapsedString() << " and "
+         << memString(sizeof(WideBVHNode) * m_wideNodes.size()) << ", "
+         << m_wideNodes.size() << " nodes)." << endl;
+
+    if (m_quantized)
+        quantize();
+}
+
+void Accel::quantize() {
+    typedef QuantizedWideBVHNode QNode;
+    const int Width = QNode::Width;
+
+    cout << "Quantizing the BVH" << NORI_BVH_WIDTH << " .. ";
+    cout.flush();
+    Timer timer;
+
+    m_quantNodes.resize(m_wideNodes.size());
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, m_wideNodes.size()),
+        [&](const tbb::blocked_range<size_t> &range) {
+            for (size_t n = range.begin(); n != range.end(); ++n) {
+                const WideBVHNode &node = m_wideNodes[n];
+                QNode &qnode = m_quantNodes[n];
+                int count = (int) node.count;
+
+                qnode.count = (uint8_t) count;
+                for (int i = 0; i < Width; ++i)
+                    qnode.child[i] = node.child[i];
+
+                for (int k = 0; k < 3; ++k) {
+                    float lo = node.min[k].head(count).minCoeff(),
+                          hi = node.max[k].head(count).maxCoeff();
+
+                    /* Smallest power-of-two spacing whose grid covers the node */
+                    int exponent = -126;
+                    if (hi > lo)
+                        exponent = std::min(std::max((int) std::ceil(
+                            std::log2((hi - lo) / 255.f)), -126), 127);
+                    qnode.origin[k] = lo;
+                    qnode.exponent[k] = (int8_t) exponent;
+                    while (exponent < 127 && lo + 255 * qnode.getScale(k) < hi)
+                        qnode.exponent[k] = (int8_t) ++exponent;
+                    float scale = qnode.getScale(k);
+
+                    /* Round outward, accounting for the rounding of the
+                       dequantization in rayIntersect() */
+                    for (int i = 0; i < Width; ++i) {
+                        if (i >= count) {
+                            qnode.qmin[k][i] = 255;
+                            qnode.qmax[k][i] = 0;
+                            continue;
+                        }
+                        int qmin = (int) std::floor((node.min[k][i] - lo) / scale),
+                            qmax = (int) std::ceil((node.max[k][i] - lo) / scale);
+                        qmin = std::min(std::max(qmin, 0), 255);
+                        qmax = std::min(std::max(qmax, 0), 255);
+                        while (qmin > 0 && qmin * scale + lo > node.min[k][i])
+                            --qmin;
+                        while (qmax < 255 && qmax * scale + lo < node.max[k][i])
+                            ++qmax;
+                        qnode.qmin[k][i] = (uint8_t) qmin;
+                        qnode.qmax[k][i] = (uint8_t) qmax;
+                    }
+                }
+            }
+        }
+    );
+
+    /* The uncompressed nodes are no longer needed */
+    m_wideNodes.clear();
+    m_wideNodes.shrink_to_fit();
+
+    cout << "done (took " << timer.elapsedString() << " and "
+         << memString(sizeof(QNode) * m_quantNodes.size()) << ")." << endl;
+}
+
+uint32_t Accel::collapse(uint32_t node_idx) {
+    const int Width = WideBVHNode::Width;
+
+    /* Start with the two children of the binary node and keep opening
+       the inner child with the largest surface area until all slots
+       are filled (or only leaves are left) */
+    uint32_t children[Width];
+    int count = 2;
+    children[0] = node_idx + 1;
+    children[1] = m_nodes[node_idx].inner.rightChild;
+
+    while (count < Width) {
+        int best = -1;
+        float bestArea = -1;
+        for (int i=0; i<count; ++i) {
+            const BVHNode &child = m_nodes[children[i]];
+            if (child.isInner() && child.bbox.getSurfaceArea() > bestArea) {
+                bestArea = child.bbox.getSurfaceArea();
+                best = i;
+            }
+        }
+        if (best == -1)
+            break;
+        uint32_t idx = children[best];
+        children[best] = idx + 1;
+        children[count++] = m_nodes[idx].inner.rightChild;
+    }
+
+    /* Sort by decreasing surface area (visiting order of occlusion queries) */
+    std::stable_sort(children, children + count, [&](uint32_t a, uint32_t b) {
+        return m_nodes[a].bbox.getSurfaceArea() > m_nodes[b].bbox.getSurfaceArea();
+    });
+
+    uint32_t wide_idx = (uint32_t) m_wideNodes.size();
+    m_wideNodes.emplace_back();
+
+    for (int i=0; i<Width; ++i) {
+        WideBVHNode &node = m_wideNodes[wide_idx];
+        if (i >= count) {
+            for (int k=0; k<3; ++k) {
+                node.min[k][i] = std::numeric_limits<float>::infinity();
+                node.max[k][i] = -std::numeric_limits<float>::infinity();
+            }
+            node.child[i] = 0;
+            continue;
+        }
+
+        const BVHNode &child = m_nodes[children[i]];
+        for (int k=0; k<3; ++k) {
+            node.min[k][i] = child.bbox.min[k];
+            node.max[k][i] = child.bbox.max[k];
+        }
+        node.child[i] = child.isLeaf() ? (WideBVHNode::LeafFlag | children[i]) : 0;
+    }
+    m_wideNodes[wide_idx].count = (uint32_t) count;
+
+    /* Recurse (note: this may reallocate 'm_wideNodes') */
+    for (int i=0; i<count; ++i) {
+        if (m_nodes[children[i]].isInner()) {
+            uint32_t child_idx = collapse(children[i]);
+            m_wideNodes[wide_idx].child[i] = child_idx;
+        }
+    }
+
+    return wide_idx;
+}
+
+std::pair<float, uint32_t> Accel::statistics(uint32_t node_idx) const {
+    const BVHNode &node = m_nodes[node_idx];
+    if (node.isLeaf()) {
+        return std::make_pair((float) BVHBuildTask::INTERSECTION_COST * node.leaf.size, 1u);
+    } else {
+        std::pair<float, uint32_t> stats_left = statistics(node_idx + 1u);
+        std::pair<float, uint32_t> stats_right = statistics(node.inner.rightChild);
+        float saLeft = m_nodes[node_idx + 1u].bbox.getSurfaceArea();
+        float saRight = m_nodes[node.inner.rightChild].bbox.getSurfaceArea();
+        float saCur = node.bbox.getSurfaceArea();
+        float sahCost =
+            2 * BVHBuildTask::TRAVERSAL_COST +
+            (saLeft * stats_left.first + saRight * stats_right.first) / saCur;
+        return std::make_pair(
+            sahCost,
+            stats_left.second + stats_right.second + 1u
+        );
+    }
+}
+
+inline bool Accel::intersectLeaf(uint32_t node_idx, Ray3f &ray, float &u, float &v,
+        uint32_t &mesh, uint32_t &f, bool shadowRay) const {
+    const BVHNode &node = m_nodes[node_idx];
+    bool foundIntersection = false;
+    float tu, tv, t;
+
+    if (!m_precompute) {
+        for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+            uint32_t idx = m_indices[i];
+            uint32_t meshIdx = findMesh(idx);
+            if (m_meshes[meshIdx]->rayIntersect(idx, ray, tu, tv, t)) {
+                foundIntersection = true;
+                ray.maxt = t; u = tu; v = tv;
+                mesh = meshIdx;
+                f = idx;
+                if (shadowRay)
+                    break;
+            }
+        }
+    } else if (m_packIntersect) {
+        const uint32_t W = TrianglePack::Size;
+        for (uint32_t i = m_packOffset[node_idx],
+                end = i + (node.leaf.size + W - 1) / W; i < end; ++i) {
+            const TrianglePack &pack = m_packs[i];
+            int lane = m_packIntersect(pack, ray, tu, tv, t);
+            if (lane >= 0) {
+                foundIntersection = true;
+                ray.maxt = t; u = tu; v = tv;
+                mesh = pack.mesh[lane];
+                f = pack.index[lane];
+                if (shadowRay)
+                    break;
+            }
+        }
+    } else {
+        for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+            const PrecomputedTriangle &tri = m_triangles[i];
+            if (tri.rayIntersect(ray, tu, tv, t)) {
+                foundIntersection = true;
+                ray.maxt = t; u = tu; v = tv;
+                mesh = tri.mesh;
+                f = tri.index;
+                if (shadowRay)
+                    break;
+            }
+        }
+    }
+
+    return foundIntersection;
+}
+
+bool Accel::rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay) const {
+    if (shadowRay)
+        return occluded(ray);
+
+    bool foundIntersection = rayIntersectTriangles(ray, its);
+
+    /* Instances and moving meshes only need to be searched
+       up to the closest hit so far */
+    if (!m_instanceNodes.empty() && rayIntersectInstances(ray, its))
+        foundIntersection = true;
+    if (m_motionAccel && m_motionAccel->rayIntersectMotion(ray, its))
+        foundIntersection = true;
+
+    return foundIntersection;
+}
+
+bool Accel::rayIntersectTriangles(const Ray3f &_ray, Intersection &its) const {
+    if (!m_quantNodes.empty())
+        return rayIntersectWide(m_quantNodes.data(), _ray, its, false);
+    else if (!m_wideNodes.empty())
+        return rayIntersectWide(m_wideNodes.data(), _ray, its, false);
+    else if (m_ordered)
+        return rayIntersectOrdered(_ray, its, false);
+
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    its.t = std::numeric_limits<float>::infinity();
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (m_nodes.empty() || ray.maxt < ray.mint)
+        return false;
 
     bool foundIntersection = false;
     uint32_t f = 0;
@@ -432,20 +1882,13 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
             node_idx++;
             assert(stack_idx<64);
         } else {
-            for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
-                uint32_t idx = m_indices[i];
-                const Mesh *mesh = m_meshes[findMesh(idx)];
-
-                float u, v, t;
-                if (mesh->rayIntersect(idx, ray, u, v, t)) {
-                    if (shadowRay)
-                        return true;
-                    foundIntersection = true;
-                    ray.maxt = its.t = t;
-                    its.uv = Point2f(u, v);
-                    its.mesh = mesh;
-                    f = idx;
-                }
+            float u, v;
+            uint32_t mesh;
+            if (intersectLeaf(node_idx, ray, u, v, mesh, f, false)) {
+                foundIntersection = true;
+                its.t = ray.maxt;
+                its.uv = Point2f(u, v);
+                its.mesh = m_meshes[mesh];
             }
             if (stack_idx == 0)
                 break;
@@ -454,53 +1897,908 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
         }
     }
 
-    if (foundIntersection) {
-        /* Find the barycentric coordinates */
-        Vector3f bary;
-        bary << 1-its.uv.sum(), its.uv;
+    if (foundIntersection)
+        fillIntersection(f, its);
 
-        /* References to all relevant mesh buffers */
-        const Mesh *mesh   = its.mesh;
-        const MatrixXf &V  = mesh->getVertexPositions();
-        const MatrixXf &N  = mesh->getVertexNormals();
-        const MatrixXf &UV = mesh->getVertexTexCoords();
-        const MatrixXu &F  = mesh->getIndices();
-
-        /* Vertex indices of the triangle */
-        uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
+    return foundIntersection;
+}
 
-        Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
+bool Accel::rayIntersectInstances(const Ray3f &_ray, Intersection &its) const {
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
 
-        /* Compute the intersection positon accurately
-           using barycentric coordinates */
-        its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+    ray.maxt = std::min(ray.maxt, its.t);
 
-        /* Compute proper texture coordinates if provided by the mesh */
-        if (UV.size() > 0)
-            its.uv = bary.x() * UV.col(idx0),
-                bary.y() * UV.col(idx1),
-                bary.z() * UV.col(idx2);
+    if (m_instanceNodes.empty() || ray.maxt < ray.mint)
+        return false;
 
-        /* Compute the geometry frame */
-        its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
+    const Instance *hit = nullptr;
 
-        if (N.size() > 0) {
-            /* Compute the shading frame. Note that for simplicity,
-               the current implementation doesn't attempt to provide
-               tangents that are continuous across the surface. That
-               means that this code will need to be modified to be able
-               use anisotropic BRDFs, which need tangent continuity */
+    while (true) {
+        const BVHNode &node = m_instanceNodes[node_idx];
+
+        if (node.bbox.rayIntersect(ray)) {
+            if (node.isInner()) {
+                stack[stack_idx++] = node.inner.rightChild;
+                node_idx++;
+                assert(stack_idx<64);
+                continue;
+            }
 
-            its.shFrame = Frame(
-                (bary.x() * N.col(idx0) +
-                 bary.y() * N.col(idx1) +
-                 bary.z() * N.col(idx2)).normalized());
-        } else {
-            its.shFrame = its.geoFrame;
+            for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+                uint32_t idx = m_instanceIndices[i];
+                const Instance *instance = m_instances[idx];
+
+                /* The object-space ray has the same parameterization */
+                Intersection local;
+                if (m_instanceAccels[idx]->rayIntersect(
+                        instance->getTransform().inverse() * ray, local)) {
+                    ray.maxt = local.t;
+                    its = local;
+                    hit = instance;
+                }
+            }
         }
+
+        if (stack_idx == 0)
+            break;
+        node_idx = stack[--stack_idx];
     }
 
-    return foundIntersection;
+    if (!hit)
+        return false;
+
+    /* Transform the intersection record into world space */
+    const Transform &trafo = hit->getTransform();
+    its.p = trafo * its.p;
+    its.geoFrame = Frame((trafo * its.geoFrame.n).normalized());
+    its.shFrame = Frame((trafo * its.shFrame.n).normalized());
+
+    return true;
+}
+
+template <int Size> bool Accel::rayIntersectLanes(
+        const TRayPacket<Size> &packet, TIntersectionPacket<Size> &its) const {
+    for (int k=0; k<Size; ++k) {
+        if (!packet.active[k])
+            continue;
+        Ray3f ray = packet.getRay(k);
+        if (!m_instanceNodes.empty() && rayIntersectInstances(ray, its[k]))
+            its.valid[k] = true;
+        if (m_motionAccel && m_motionAccel->rayIntersectMotion(ray, its[k]))
+            its.valid[k] = true;
+    }
+    return its.valid.any();
+}
+
+bool Accel::occludedInstances(const Ray3f &_ray) const {
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (m_instanceNodes.empty() || ray.maxt < ray.mint)
+        return false;
+
+    while (true) {
+        const BVHNode &node = m_instanceNodes[node_idx];
+
+        if (node.bbox.rayIntersect(ray)) {
+            if (node.isInner()) {
+                stack[stack_idx++] = node.inner.rightChild;
+                node_idx++;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+                uint32_t idx = m_instanceIndices[i];
+                if (m_instanceAccels[idx]->occluded(
+                        m_instances[idx]->getTransform().inverse() * ray))
+                    return true;
+            }
+        }
+
+        if (stack_idx == 0)
+            return false;
+        node_idx = stack[--stack_idx];
+    }
+}
+
+inline bool Accel::intersectLeafMotion(uint32_t node_idx, Ray3f &ray, float &u, float &v,
+        uint32_t &mesh, uint32_t &f, bool shadowRay) const {
+    const BVHNode &node = m_nodes[node_idx];
+    bool foundIntersection = false;
+    float tu, tv, t;
+
+    for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+        uint32_t idx = m_indices[i];
+        uint32_t meshIdx = findMesh(idx);
+        const Mesh *m = m_meshes[meshIdx];
+        const MatrixXuView &F = m->getIndices();
+
+        /* Triangle at the time of the ray (moving meshes are never compressed) */
+        PrecomputedTriangle tri;
+        tri.p0 = m->getVertexPosition(F(0, idx), ray.time);
+        tri.e1 = m->getVertexPosition(F(1, idx), ray.time) - tri.p0;
+        tri.e2 = m->getVertexPosition(F(2, idx), ray.time) - tri.p0;
+
+        if (tri.rayIntersect(ray, tu, tv, t)) {
+            foundIntersection = true;
+            ray.maxt = t; u = tu; v = tv;
+            mesh = meshIdx;
+            f = idx;
+            if (shadowRay)
+                break;
+        }
+    }
+
+    return foundIntersection;
+}
+
+bool Accel::rayIntersectMotion(const Ray3f &_ray, Intersection &its) const {
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+    ray.maxt = std::min(ray.maxt, its.t);
+    ray.time = std::min(std::max(ray.time, 0.f), 1.f);
+
+    if (m_nodes.empty() || ray.maxt < ray.mint)
+        return false;
+
+    bool foundIntersection = false;
+    uint32_t f = 0;
+
+    while (true) {
+        if (getMotionBounds(node_idx, ray.time).rayIntersect(ray)) {
+            const BVHNode &node = m_nodes[node_idx];
+            if (node.isInner()) {
+                stack[stack_idx++] = node.inner.rightChild;
+                node_idx++;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            float u, v;
+            uint32_t mesh;
+            if (intersectLeafMotion(node_idx, ray, u, v, mesh, f, false)) {
+                foundIntersection = true;
+                its.t = ray.maxt;
+                its.uv = Point2f(u, v);
+                its.mesh = m_meshes[mesh];
+            }
+        }
+
+        if (stack_idx == 0)
+            break;
+        node_idx = stack[--stack_idx];
+    }
+
+    if (foundIntersection)
+        fillIntersection(f, its, ray.time);
+
+    return foundIntersection;
+}
+
+bool Accel::occludedMotion(const Ray3f &_ray) const {
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+    ray.time = std::min(std::max(ray.time, 0.f), 1.f);
+
+    if (m_nodes.empty() || ray.maxt < ray.mint)
+        return false;
+
+    while (true) {
+        if (getMotionBounds(node_idx, ray.time).rayIntersect(ray)) {
+            const BVHNode &node = m_nodes[node_idx];
+            if (node.isInner()) {
+                uint32_t first = node_idx + 1, second = node.inner.rightChild;
+                if (node.inner.rightFirst)
+                    std::swap(first, second);
+                stack[stack_idx++] = second;
+                node_idx = first;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            float u, v;
+            uint32_t mesh, f;
+            if (intersectLeafMotion(node_idx, ray, u, v, mesh, f, true))
+                return true;
+        }
+
+        if (stack_idx == 0)
+            return false;
+        node_idx = stack[--stack_idx];
+    }
+}
+
+bool Accel::rayIntersectOrdered(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
+    /* Stack entries store the entry distance along the ray, which
+       makes it possible to skip nodes behind the closest hit */
+    struct StackEntry {
+        uint32_t node;
+        float nearT;
+    } stack[64];
+    uint32_t node_idx = 0, stack_idx = 0;
+
+    its.t = std::numeric_limits<float>::infinity();
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (m_nodes.empty() || ray.maxt < ray.mint ||
+        !m_nodes[0].bbox.rayIntersect(ray))
+        return false;
+
+    bool foundIntersection = false;
+    uint32_t f = 0;
+
+    while (true) {
+        const BVHNode &node = m_nodes[node_idx];
+
+        if (node.isInner()) {
+            /* The left child contains the primitives with smaller
+               centroids along the split axis -- visit it first
+               unless the ray points the other way */
+            uint32_t near = node_idx + 1, far = node.inner.rightChild;
+            if (ray.d[node.inner.axis] < 0)
+                std::swap(near, far);
+
+            float nearT0, farT0, nearT1, farT1;
+            bool hitNear = m_nodes[near].bbox.rayIntersect(ray, nearT0, farT0) &&
+                           nearT0 <= ray.maxt && farT0 >= ray.mint;
+            bool hitFar  = m_nodes[far].bbox.rayIntersect(ray, nearT1, farT1) &&
+                           nearT1 <= ray.maxt && farT1 >= ray.mint;
+
+            if (hitNear) {
+                if (hitFar) {
+                    stack[stack_idx++] = StackEntry { far, nearT1 };
+                    assert(stack_idx<64);
+                }
+                node_idx = near;
+                continue;
+            } else if (hitFar) {
+                node_idx = far;
+                continue;
+            }
+        } else {
+            float u, v;
+            uint32_t mesh;
+            if (intersectLeaf(node_idx, ray, u, v, mesh, f, shadowRay)) {
+                if (shadowRay)
+                    return true;
+                foundIntersection = true;
+                its.t = ray.maxt;
+                its.uv = Point2f(u, v);
+                its.mesh = m_meshes[mesh];
+            }
+        }
+
+        /* Pop the next node, skipping those behind the closest hit */
+        bool haveNode = false;
+        while (stack_idx > 0 && !haveNode) {
+            const StackEntry &entry = stack[--stack_idx];
+            if (entry.nearT <= ray.maxt) {
+                node_idx = entry.node;
+                haveNode = true;
+            }
+        }
+
+        if (!haveNode)
+            break;
+    }
+
+    if (foundIntersection)
+        fillIntersection(f, its);
+
+    return foundIntersection;
+}
+
+template <typename Node> bool Accel::rayIntersectWide(const Node *nodes,
+        const Ray3f &_ray, Intersection &its, bool shadowRay) const {
+    typedef typename Node::FloatPacket FloatPacket;
+    const int Width = Node::Width;
+
+    /* Stack entries store the entry distance along the ray, which
+       makes it possible to skip nodes behind the closest hit */
+    struct StackEntry {
+        uint32_t node;
+        float nearT;
+    } stack[64 * Width];
+    uint32_t stack_idx = 0;
+
+    its.t = std::numeric_limits<float>::infinity();
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (ray.maxt < ray.mint)
+        return false;
+
+    /* Reciprocal directions that are safe to use in the SIMD slab test
+       (avoids 0 * inf = NaN for axis-parallel rays) */
+    float dRcp[3];
+    for (int i=0; i<3; ++i)
+        dRcp[i] = ray.d[i] != 0 ? ray.dRcp[i] : std::numeric_limits<float>::max();
+
+    bool foundIntersection = false;
+    uint32_t f = 0, node_idx = 0;
+
+    while (true) {
+        const Node &node = nodes[node_idx];
+
+        /* Test the ray against all children at once */
+        FloatPacket nearT = FloatPacket::Constant(ray.mint),
+                    farT  = FloatPacket::Constant(ray.maxt);
+        node.rayIntersect(ray.o, dRcp, nearT, farT);
+
+        /* Collect the children that were hit, sorted from near to far */
+        StackEntry hit[Width];
+        int hitCount = 0;
+        for (int i=0; i<(int) node.count; ++i) {
+            if (!(nearT[i] <= farT[i]))
+                continue;
+            int j = hitCount++;
+            while (j > 0 && hit[j-1].nearT > nearT[i]) {
+                hit[j] = hit[j-1];
+                --j;
+            }
+            hit[j].node = node.child[i];
+            hit[j].nearT = nearT[i];
+        }
+
+        /* Push them onto the stack so that the nearest one is popped first */
+        for (int i=hitCount-1; i>=0; --i)
+            stack[stack_idx++] = hit[i];
+        assert(stack_idx < 64 * Width);
+
+        /* Process the next node; leaves are intersected right away */
+        bool haveNode = false;
+        while (stack_idx > 0 && !haveNode) {
+            const StackEntry &entry = stack[--stack_idx];
+            if (entry.nearT > ray.maxt)
+                continue;
+
+            if ((entry.node & WideBVHNode::LeafFlag) == 0) {
+                node_idx = entry.node;
+                haveNode = true;
+                continue;
+            }
+
+            float u, v;
+            uint32_t mesh;
+            if (intersectLeaf(entry.node & ~WideBVHNode::LeafFlag, ray, u, v,
+                              mesh, f, shadowRay)) {
+                if (shadowRay)
+                    return true;
+                foundIntersection = true;
+                its.t = ray.maxt;
+                its.uv = Point2f(u, v);
+                its.mesh = m_meshes[mesh];
+            }
+        }
+
+        if (!haveNode)
+            break;
+    }
+
+    if (foundIntersection)
+        fillIntersection(f, its);
+
+    return foundIntersection;
+}
+
+bool Accel::occluded(const Ray3f &_ray) const {
+    if (!m_instanceNodes.empty() && occludedInstances(_ray))
+        return true;
+    else if (m_motionAccel && m_motionAccel->occludedMotion(_ray))
+        return true;
+    else if (!m_quantNodes.empty())
+        return occludedWide(m_quantNodes.data(), _ray);
+    else if (!m_wideNodes.empty())
+        return occludedWide(m_wideNodes.data(), _ray);
+
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (m_nodes.empty() || ray.maxt < ray.mint)
+        return false;
+
+    while (true) {
+        const BVHNode &node = m_nodes[node_idx];
+
+        if (node.bbox.rayIntersect(ray)) {
+            if (node.isInner()) {
+                uint32_t first = node_idx + 1, second = node.inner.rightChild;
+                if (node.inner.rightFirst)
+                    std::swap(first, second);
+                stack[stack_idx++] = second;
+                node_idx = first;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            float u, v;
+            uint32_t mesh, f;
+            if (intersectLeaf(node_idx, ray, u, v, mesh, f, true))
+                return true;
+        }
+
+        if (stack_idx == 0)
+            return false;
+        node_idx = stack[--stack_idx];
+    }
+}
+
+template <typename Node> bool Accel::occludedWide(const Node *nodes,
+        const Ray3f &_ray) const {
+    typedef typename Node::FloatPacket FloatPacket;
+    const int Width = Node::Width;
+
+    uint32_t node_idx = 0, stack_idx = 0, stack[64 * Width];
+
+    /* Use an adaptive ray epsilon */
+    Ray3f ray(_ray);
+    if (ray.mint == Epsilon)
+        ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+    if (ray.maxt < ray.mint)
+        return false;
+
+    float dRcp[3];
+    for (int i=0; i<3; ++i)
+        dRcp[i] = ray.d[i] != 0 ? ray.dRcp[i] : std::numeric_limits<float>::max();
+
+    while (true) {
+        const Node &node = nodes[node_idx];
+
+        FloatPacket nearT = FloatPacket::Constant(ray.mint),
+                    farT  = FloatPacket::Constant(ray.maxt);
+        node.rayIntersect(ray.o, dRcp, nearT, farT);
+
+        /* Children are sorted by decreasing surface area; push them
+           in reverse so that the largest one is popped first */
+        for (int i=(int) node.count-1; i>=0; --i) {
+            if (nearT[i] <= farT[i])
+                stack[stack_idx++] = node.child[i];
+        }
+        assert(stack_idx < 64 * Width);
+
+        bool haveNode = false;
+        while (stack_idx > 0 && !haveNode) {
+            uint32_t entry = stack[--stack_idx];
+            if ((entry & WideBVHNode::LeafFlag) == 0) {
+                node_idx = entry;
+                haveNode = true;
+                continue;
+            }
+
+            float u, v;
+            uint32_t mesh, f;
+            if (intersectLeaf(entry & ~WideBVHNode::LeafFlag, ray, u, v, mesh, f, true))
+                return true;
+        }
+
+        if (!haveNode)
+            return false;
+    }
+}
+
+/// Convert a mask of packet lanes into a bit mask
+template <typename MaskPacket> static inline uint32_t laneBits(const MaskPacket &mask) {
+    uint32_t bits = 0;
+    for (int k=0; k<(int) mask.size(); ++k) {
+        if (mask[k])
+            bits |= 1u << k;
+    }
+    return bits;
+}
+
+template <int Size> typename TRayPacket<Size>::MaskPacket
+        Accel::occluded(const TRayPacket<Size> &_packet) const {
+    typedef typename TRayPacket<Size>::MaskPacket MaskPacket;
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    MaskPacket result;
+    result.setConstant(false);
+
+    /* Use an adaptive ray epsilon (per lane) */
+    TRayPacket<Size> packet(_packet);
+    Ray3f rays[Size];
+    for (int i=0; i<Size; ++i) {
+        if (!packet.active[i])
+            continue;
+        if (packet.mint[i] == Epsilon)
+            packet.mint[i] = std::max(packet.mint[i], packet.mint[i] *
+                std::max(std::max(std::abs(packet.o[0][i]), std::abs(packet.o[1][i])),
+                         std::abs(packet.o[2][i])));
+        if (packet.maxt[i] < packet.mint[i])
+            packet.active[i] = false;
+        packet.getRay(i, rays[i]);
+    }
+
+    if (!m_instanceNodes.empty() || m_motionAccel) {
+        for (int i=0; i<Size; ++i) {
+            if (!packet.active[i])
+                continue;
+            Ray3f ray = _packet.getRay(i);
+            if ((!m_instanceNodes.empty() && occludedInstances(ray)) ||
+                (m_motionAccel && m_motionAccel->occludedMotion(ray))) {
+                result[i] = true;
+                packet.active[i] = false;
+            }
+        }
+    }
+
+    if (m_nodes.empty() || !packet.active.any())
+        return result;
+
+    if (!m_quantNodes.empty()) {
+        occludedWide(m_quantNodes.data(), packet, rays, result);
+        return result;
+    } else if (!m_wideNodes.empty()) {
+        occludedWide(m_wideNodes.data(), packet, rays, result);
+        return result;
+    }
+
+    while (true) {
+        const BVHNode &node = m_nodes[node_idx];
+        MaskPacket hit = packet.rayIntersect(node.bbox);
+
+        if (hit.any()) {
+            if (node.isInner()) {
+                uint32_t first = node_idx + 1, second = node.inner.rightChild;
+                if (node.inner.rightFirst)
+                    std::swap(first, second);
+                stack[stack_idx++] = second;
+                node_idx = first;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            for (int k=0; k<Size; ++k) {
+                if (!hit[k])
+                    continue;
+
+                float u, v;
+                uint32_t mesh, f;
+                if (intersectLeaf(node_idx, rays[k], u, v, mesh, f, true)) {
+                    /* This lane is done */
+                    result[k] = true;
+                    packet.active[k] = false;
+                }
+            }
+
+            if (!packet.active.any())
+                break;
+        }
+
+        if (stack_idx == 0)
+            break;
+        node_idx = stack[--stack_idx];
+    }
+
+    return result;
+}
+
+template <typename Node, int Size> void Accel::occludedWide(const Node *nodes,
+        TRayPacket<Size> &packet, Ray3f *rays,
+        typename TRayPacket<Size>::MaskPacket &result) const {
+    const int Width = Node::Width;
+
+    /* Stack entries store the lanes whose rays hit the node */
+    struct StackEntry {
+        uint32_t node;
+        uint32_t lanes;
+    } stack[64 * Width];
+    uint32_t node_idx = 0, stack_idx = 0, lanes = laneBits(packet.active);
+
+    while (true) {
+        const Node &node = nodes[node_idx];
+
+        /* Children are sorted by decreasing surface area; push them
+           in reverse so that the largest one is popped first */
+        for (int i=(int) node.count-1; i>=0; --i) {
+            uint32_t hit = laneBits(packet.rayIntersect(node.getBounds(i))) & lanes;
+            if (hit)
+                stack[stack_idx++] = StackEntry { node.child[i], hit };
+        }
+        assert(stack_idx < 64 * Width);
+
+        bool haveNode = false;
+        while (stack_idx > 0 && !haveNode) {
+            const StackEntry &entry = stack[--stack_idx];
+
+            /* Skip lanes that were found to be occluded in the meantime */
+            lanes = entry.lanes & laneBits(packet.active);
+            if (!lanes)
+                continue;
+
+            if ((entry.node & WideBVHNode::LeafFlag) == 0) {
+                node_idx = entry.node;
+                haveNode = true;
+                continue;
+            }
+
+            for (int k=0; k<Size; ++k) {
+                if (!(lanes & (1u << k)))
+                    continue;
+
+                float u, v;
+                uint32_t mesh, f;
+                if (intersectLeaf(entry.node & ~WideBVHNode::LeafFlag, rays[k],
+                                  u, v, mesh, f, true)) {
+                    result[k] = true;
+                    packet.active[k] = false;
+                }
+            }
+
+            if (!packet.active.any())
+                return;
+        }
+
+        if (!haveNode)
+            return;
+    }
+}
+
+template RayPacket4::MaskPacket Accel::occluded<4>(const RayPacket4 &) const;
+template RayPacket8::MaskPacket Accel::occluded<8>(const RayPacket8 &) const;
+template RayPacket16::MaskPacket Accel::occluded<16>(const RayPacket16 &) const;
+
+template <int Size> bool Accel::rayIntersect(const TRayPacket<Size> &_packet,
+        TIntersectionPacket<Size> &its) const {
+    its.valid.setConstant(false);
+
+    /* Use an adaptive ray epsilon (per lane) */
+    TRayPacket<Size> packet(_packet);
+    Ray3f rays[Size];
+    uint32_t f[Size];
+    for (int i=0; i<Size; ++i) {
+        if (!packet.active[i])
+            continue;
+        its[i].t = std::numeric_limits<float>::infinity();
+        if (packet.mint[i] == Epsilon)
+            packet.mint[i] = std::max(packet.mint[i], packet.mint[i] *
+                std::max(std::max(std::abs(packet.o[0][i]), std::abs(packet.o[1][i])),
+                         std::abs(packet.o[2][i])));
+        if (packet.maxt[i] < packet.mint[i])
+            packet.active[i] = false;
+        packet.getRay(i, rays[i]);
+    }
+
+    if (m_nodes.empty() || !packet.active.any())
+        return rayIntersectLanes(_packet, its);
+
+    if (!m_quantNodes.empty())
+        rayIntersectWide(m_quantNodes.data(), packet, rays, f, its);
+    else if (!m_wideNodes.empty())
+        rayIntersectWide(m_wideNodes.data(), packet, rays, f, its);
+    else
+        rayIntersectPacket(packet, rays, f, its);
+
+    for (int k=0; k<Size; ++k) {
+        if (its.valid[k])
+            fillIntersection(f[k], its[k]);
+    }
+
+    if (!m_instanceNodes.empty() || m_motionAccel)
+        rayIntersectLanes(_packet, its);
+
+    return its.valid.any();
+}
+
+template <int Size> void Accel::rayIntersectPacket(TRayPacket<Size> &packet,
+        Ray3f *rays, uint32_t *f, TIntersectionPacket<Size> &its) const {
+    typedef typename TRayPacket<Size>::FloatPacket FloatPacket;
+    typedef typename TRayPacket<Size>::MaskPacket MaskPacket;
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Front-to-back traversal (see orderedTraversal) follows the
+       average direction of the rays, which are assumed to be coherent */
+    float d[3] = { 0.f, 0.f, 0.f };
+    if (m_ordered) {
+        for (int i=0; i<3; ++i)
+            d[i] = packet.active.select(packet.d[i], FloatPacket::Zero()).sum();
+    }
+
+    while (true) {
+        const BVHNode &node = m_nodes[node_idx];
+
+        /* Test all rays of the packet against the node at once */
+        MaskPacket hit = packet.rayIntersect(node.bbox);
+
+        if (!hit.any()) {
+            if (stack_idx == 0)
+                break;
+            node_idx = stack[--stack_idx];
+            continue;
+        }
+
+        if (node.isInner()) {
+            uint32_t near = node_idx + 1, far = node.inner.rightChild;
+            if (d[node.inner.axis] < 0)
+                std::swap(near, far);
+            stack[stack_idx++] = far;
+            node_idx = near;
+            assert(stack_idx<64);
+        } else {
+            for (int k=0; k<Size; ++k) {
+                if (!hit[k])
+                    continue;
+
+                float u = 0, v = 0;
+                uint32_t mesh;
+                if (intersectLeaf(node_idx, rays[k], u, v, mesh, f[k], false)) {
+                    its.valid[k] = true;
+                    packet.maxt[k] = its[k].t = rays[k].maxt;
+                    its[k].uv = Point2f(u, v);
+                    its[k].mesh = m_meshes[mesh];
+                }
+            }
+            if (stack_idx == 0)
+                break;
+            node_idx = stack[--stack_idx];
+            continue;
+        }
+    }
+}
+
+template <typename Node, int Size> void Accel::rayIntersectWide(const Node *nodes,
+        TRayPacket<Size> &packet, Ray3f *rays, uint32_t *f,
+        TIntersectionPacket<Size> &its) const {
+    typedef typename TRayPacket<Size>::FloatPacket FloatPacket;
+    const int Width = Node::Width;
+
+    /* Stack entries store the lanes whose rays hit the node and their
+       smallest entry distance, which makes it possible to skip nodes
+       that lie behind the closest hits of all of these lanes */
+    struct StackEntry {
+        uint32_t node;
+        uint32_t lanes;
+        float nearT;
+    } stack[64 * Width];
+    uint32_t node_idx = 0, stack_idx = 0, lanes = laneBits(packet.active);
+
+    while (true) {
+        const Node &node = nodes[node_idx];
+
+        /* Collect the children that were hit, sorted from near to far */
+        StackEntry hit[Width];
+        int hitCount = 0;
+        for (int i=0; i<(int) node.count; ++i) {
+            FloatPacket nearT;
+            uint32_t hitLanes = laneBits(packet.rayIntersect(node.getBounds(i), nearT)) & lanes;
+            if (!hitLanes)
+                continue;
+
+            float minT = std::numeric_limits<float>::infinity();
+            for (int k=0; k<Size; ++k) {
+                if (hitLanes & (1u << k))
+                    minT = std::min(minT, nearT[k]);
+            }
+
+            int j = hitCount++;
+            while (j > 0 && hit[j-1].nearT > minT) {
+                hit[j] = hit[j-1];
+                --j;
+            }
+            hit[j] = StackEntry { node.child[i], hitLanes, minT };
+        }
+
+        /* Push them onto the stack so that the nearest one is popped first */
+        for (int i=hitCount-1; i>=0; --i)
+            stack[stack_idx++] = hit[i];
+        assert(stack_idx < 64 * Width);
+
+        /* Process the next node; leaves are intersected right away */
+        bool haveNode = false;
+        while (stack_idx > 0 && !haveNode) {
+            const StackEntry &entry = stack[--stack_idx];
+
+            lanes = 0;
+            for (int k=0; k<Size; ++k) {
+                if ((entry.lanes & (1u << k)) && entry.nearT <= packet.maxt[k])
+                    lanes |= 1u << k;
+            }
+            if (!lanes)
+                continue;
+
+            if ((entry.node & WideBVHNode::LeafFlag) == 0) {
+                node_idx = entry.node;
+                haveNode = true;
+                continue;
+            }
+
+            for (int k=0; k<Size; ++k) {
+                if (!(lanes & (1u << k)))
+                    continue;
+
+                float u = 0, v = 0;
+                uint32_t mesh;
+                if (intersectLeaf(entry.node & ~WideBVHNode::LeafFlag, rays[k],
+                                  u, v, mesh, f[k], false)) {
+                    its.valid[k] = true;
+                    packet.maxt[k] = its[k].t = rays[k].maxt;
+                    its[k].uv = Point2f(u, v);
+                    its[k].mesh = m_meshes[mesh];
+                }
+            }
+        }
+
+        if (!haveNode)
+            break;
+    }
+}
+
+template bool Accel::rayIntersect<4>(const RayPacket4 &, IntersectionPacket4 &) const;
+template bool Accel::rayIntersect<8>(const RayPacket8 &, IntersectionPacket8 &) const;
+template bool Accel::rayIntersect<16>(const RayPacket16 &, IntersectionPacket16 &) const;
+
+void Accel::fillIntersection(uint32_t f, Intersection &its, float time) const {
+    /* Find the barycentric coordinates */
+    Vector3f bary;
+    bary << 1-its.uv.sum(), its.uv;
+
+    /* Compressed meshes decode their vertex data here */
+    const Mesh *mesh = its.mesh;
+
+    /* Vertex indices of the triangle */
+    uint32_t idx0 = mesh->getVertexIndex(f, 0), idx1 = mesh->getVertexIndex(f, 1),
+             idx2 = mesh->getVertexIndex(f, 2);
+
+    Point3f p0 = mesh->getVertexPosition(idx0, time),
+            p1 = mesh->getVertexPosition(idx1, time),
+            p2 = mesh->getVertexPosition(idx2, time);
+
+    /* Compute the intersection positon accurately
+       using barycentric coordinates */
+    its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+
+    /* Compute proper texture coordinates if provided by the mesh */
+    if (mesh->hasVertexTexCoords())
+        its.uv = bary.x() * mesh->getVertexTexCoord(idx0),
+            bary.y() * mesh->getVertexTexCoord(idx1),
+            bary.z() * mesh->getVertexTexCoord(idx2);
+
+    /* Compute the geometry frame */
+    its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
+
+    if (mesh->hasVertexNormals()) {
+        /* Compute the shading frame. Note that for simplicity,
+           the current implementation doesn't attempt to provide
+           tangents that are continuous across the surface. That
+           means that this code will need to be modified to be able
+           use anisotropic BRDFs, which need tangent continuity */
+
+        its.shFrame = Frame(
+            (bary.x() * mesh->getVertexNormal(idx0, time) +
+             bary.y() * mesh->getVertexNormal(idx1, time) +
+             bary.z() * mesh->getVertexNormal(idx2, time)).normalized());
+    } else {
+        its.shFrame = its.geoFrame;
+    }
 }
 
 NORI_NAMESPACE_END
@@ -0,0 +1,83 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/adaptive.h>
+#include <nori/block.h>
+
+NORI_NAMESPACE_BEGIN
+
+SampleAllocator::SampleAllocator(const Vector2i &size, float errorTarget)
+        : m_errorTarget(errorTarget) {
+    if (errorTarget <= 0)
+        throw NoriException("SampleAllocator: the error target must be positive!");
+    m_sampleMap.setZero(size.y(), size.x());
+    m_error.resize(size.y(), size.x());
+    m_scratch.resize(size.y(), size.x());
+}
+
+size_t SampleAllocator::plan(const ImageBlock &image, size_t budget) {
+    int width = (int) m_sampleMap.cols(), height = (int) m_sampleMap.rows();
+
+    /* Estimate the relative error of every pixel. Pixels without a
+       variance estimate have an unknown (i.e. infinite) error */
+    for (int y=0; y<height; ++y) {
+        for (int x=0; x<width; ++x) {
+            const PixelStatistics &stats = image.getStatistics(x, y);
+            if (stats.count < 2) {
+                m_error(y, x) = std::numeric_limits<float>::infinity();
+                continue;
+            }
+            m_error(y, x) = std::sqrt(stats.getVariance() / stats.count) /
+                std::max(std::abs(stats.mean), NORI_ADAPTIVE_MIN_LUMINANCE);
+        }
+    }
+
+    /* Take the maximum error over the 3x3 neighborhood of each pixel */
+    for (int y=0; y<height; ++y)
+        for (int x=0; x<width; ++x)
+            m_scratch(y, x) = m_error.row(y).segment(std::max(x-1, 0),
+                std::min(x+1, width-1) - std::max(x-1, 0) + 1).maxCoeff();
+    for (int y=0; y<height; ++y)
+        for (int x=0; x<width; ++x)
+            m_error(y, x) = m_scratch.col(x).segment(std::max(y-1, 0),
+                std::min(y+1, height-1) - std::max(y-1, 0) + 1).maxCoeff();
+
+    /* Number of samples that is expected to bring the error of each pixel
+       down to the target (the error decreases with 1/sqrt(samples)), but
+       at most as many as the pixel has already received */
+    double requested = 0;
+    m_activePixels = 0;
+    for (int y=0; y<height; ++y) {
+        for (int x=0; x<width; ++x) {
+            float count = image.getStatistics(x, y).count, ratio = m_error(y, x) / m_errorTarget;
+            float need = 0;
+            if (ratio > 1) {
+                need = count < 1 ? 1.0f : std::min(std::ceil(count * (ratio*ratio - 1)), count);
+                ++m_activePixels;
+            }
+            m_scratch(y, x) = need;
+            requested += need;
+        }
+    }
+
+    /* Scale the requests down to the budget. Pixels receive the rounded
+       running sum of the scaled requests minus the samples assigned so
+       far, so that the total matches the budget exactly */
+    double scale = requested > (double) budget ? budget / requested : 1.0, sum = 0;
+    size_t total = 0;
+    for (int y=0; y<height; ++y) {
+        for (int x=0; x<width; ++x) {
+            sum += m_scratch(y, x) * scale;
+            size_t assigned = std::min((size_t) std::llround(sum), budget);
+            m_sampleMap(y, x) = (uint32_t) (assigned - total);
+            total = assigned;
+        }
+    }
+
+    return total;
+}
+
+NORI_NAMESPACE_END
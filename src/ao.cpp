@@ -15,13 +15,22 @@ public:
         Intersection its;
         if (!scene->rayIntersect(ray, its))
             return Color3f(0.0f);
-        Point3f p = its.p;
+        return LiPrimary(scene, sampler, ray, &its);
+    }
+
+    Color3f LiPrimary(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                      const Intersection *its) const {
+        if (!its)
+            return Color3f(0.0f);
+        Point3f p = its->p;
         Point2f sample = sampler->next2D();
         Vector3f wi = Warp::squareToCosineHemisphere(sample);
-        wi = its.shFrame.toWorld(wi);
+        wi = its->shFrame.toWorld(wi);
         
         float visible = 1.0f;
-        if (scene->rayIntersect(Ray3f(p, wi)))
+        Ray3f shadowRay(p, wi);
+        shadowRay.time = ray.time;
+        if (scene->rayIntersect(shadowRay))
             visible = 0.0f;
         /**
          * In fact, Li = visible * (cos\theta / pi) / pdf, 
@@ -32,6 +41,8 @@ public:
         return Li;
     }
 
+    bool usesPrimaryPackets() const { return true; }
+
     std::string toString() const {
         return "AOIntegrator[]";
     }
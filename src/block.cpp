@@ -15,31 +15,26 @@ NORI_NAMESPACE_BEGIN
 ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter) 
         : m_offset(0, 0), m_size(size) {
     if (filter) {
-        /* Tabulate the image reconstruction filter for performance reasons */
-        m_filterRadius = filter->getRadius();
-        m_borderSize = (int) std::ceil(m_filterRadius - 0.5f);
-        m_filter = new float[NORI_FILTER_RESOLUTION + 1];
-        for (int i=0; i<NORI_FILTER_RESOLUTION; ++i) {
-            float pos = (m_filterRadius * i) / NORI_FILTER_RESOLUTION;
-            m_filter[i] = filter->eval(pos);
-        }
-        m_filter[NORI_FILTER_RESOLUTION] = 0.0f;
-        m_lookupFactor = NORI_FILTER_RESOLUTION / m_filterRadius;
-        int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
-        m_weightsX = new float[weightSize];
-        m_weightsY = new float[weightSize];
-        memset(m_weightsX, 0, sizeof(float) * weightSize);
-        memset(m_weightsY, 0, sizeof(float) * weightSize);
+        /* Refer to the filter's shared table instead of tabulating it again */
+        m_filter = &filter->getTable();
+        if (m_filter->lookupFactor == 0)
+            throw NoriException("ImageBlock: the reconstruction filter has not been activated!");
+        m_borderSize = m_filter->borderSize;
     }
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+
+    /* One mutex per stripe of rows */
+    m_stripeCount = ((int) rows() + NORI_BLOCK_STRIPE - 1) / NORI_BLOCK_STRIPE;
+    m_stripes.reset(new tbb::mutex[std::max(m_stripeCount, 1)]);
 }
 
-ImageBlock::~ImageBlock() {
-    delete[] m_filter;
-    delete[] m_weightsX;
-    delete[] m_weightsY;
+void ImageBlock::enableStatistics() {
+    /* One entry per pixel of the largest block, without the border */
+    m_statsStride = (int) cols() - 2*m_borderSize;
+    m_stats.assign((size_t) m_statsStride * (size_t) (rows() - 2*m_borderSize),
+                   PixelStatistics());
 }
 
 Bitmap *ImageBlock::toBitmap() const {
@@ -73,32 +68,143 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
     );
 
     /* Compute the rectangle of pixels that will need to be updated */
+    const float radius = m_filter->radius, lookupFactor = m_filter->lookupFactor;
     BoundingBox2i bbox(
-        Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
-        Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
+        Point2i((int)  std::ceil(pos.x() - radius), (int)  std::ceil(pos.y() - radius)),
+        Point2i((int) std::floor(pos.x() + radius), (int) std::floor(pos.y() + radius))
     );
     bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
 
-    /* Lookup values from the pre-rasterized filter */
-    for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
-        m_weightsX[idx++] = m_filter[(int) (std::abs(x-pos.x()) * m_lookupFactor)];
-    for (int y=bbox.min.y(), idx = 0; y<=bbox.max.y(); ++y)
-        m_weightsY[idx++] = m_filter[(int) (std::abs(y-pos.y()) * m_lookupFactor)];
+    /* Lookup values from the pre-rasterized filter. The weights are
+       looked up on the fly (rather than tabulated in scratch space
+       first), which keeps this function reentrant */
+    const float *filter = m_filter->values;
+    for (int y=bbox.min.y(); y<=bbox.max.y(); ++y) {
+        float weightY = filter[(int) (std::abs(y-pos.y()) * lookupFactor)];
+        for (int x=bbox.min.x(); x<=bbox.max.x(); ++x) {
+            float weightX = filter[(int) (std::abs(x-pos.x()) * lookupFactor)];
+            coeffRef(y, x) += Color4f(value) * weightX * weightY;
+        }
+    }
+}
+
+void ImageBlock::put(const Point2f *pos, const Color3f *value, size_t count) {
+    const int width = 2*m_borderSize + 1;
+
+    for (size_t start = 0, end; start < count; start = end) {
+        /* Find the run of samples that lie in the same pixel */
+        Point2i pixel((int) std::floor(pos[start].x()), (int) std::floor(pos[start].y()));
+        bool valid = value[start].isValid();
+        for (end = start + 1; end < count; ++end) {
+            if ((int) std::floor(pos[end].x()) != pixel.x() ||
+                (int) std::floor(pos[end].y()) != pixel.y())
+                break;
+            valid &= value[end].isValid();
+        }
+
+        Point2i rel = pixel - m_offset;
+        bool inside = (rel.array() >= 0).all() && (rel.array() < m_size.array()).all();
 
-    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
-        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
-            coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+        /* Record the luminance of the run's samples in the pixel's statistics */
+        if (inside && !m_stats.empty()) {
+            PixelStatistics &stats = m_stats[rel.y() * m_statsStride + rel.x()];
+            for (size_t i=start; i<end; ++i) {
+                if (valid || value[i].isValid())
+                    stats.put(value[i].getLuminance());
+            }
+        }
+
+        /* Short runs are cheaper to splat one sample at a time */
+        if (!valid || end - start < 4 || !inside) {
+            for (size_t i=start; i<end; ++i)
+                put(pos[i], value[i]);
+            continue;
+        }
+
+        /* Tabulate the filter weights of all samples over the footprint
+           (the pixel and its border neighborhood). Pixels of the footprint
+           that are out of a sample's filter radius receive a zero weight.
+           Column k holds the weights of footprint column/row k */
+        size_t n = end - start;
+        size_t tableSize = n * (size_t) width;
+        if (m_batchScratch.size() < 3 * tableSize + 4 * n + width * width)
+            m_batchScratch.resize(3 * tableSize + 4 * n + width * width);
+        float *scratch = m_batchScratch.data();
+        Eigen::Map<Eigen::MatrixXf> weightsX(scratch, n, width);
+        Eigen::Map<Eigen::MatrixXf> weightsY(scratch + tableSize, n, width);
+        Eigen::Map<Eigen::MatrixXf> scaled(scratch + 2 * tableSize, n, width);
+        Eigen::Map<Eigen::MatrixXf> values(scratch + 3 * tableSize, n, 4);
+        Eigen::Map<Eigen::MatrixXf> footprint(scratch + 3 * tableSize + 4 * n, width, width);
+
+        const float *filter = m_filter->values;
+        const float lookupFactor = m_filter->lookupFactor;
+        for (size_t i=0; i<n; ++i) {
+            /* Same conversion to block coordinates as in the per-sample code */
+            float px = pos[start + i].x() - 0.5f - (m_offset.x() - m_borderSize);
+            float py = pos[start + i].y() - 0.5f - (m_offset.y() - m_borderSize);
+            for (int k=0; k<width; ++k) {
+                weightsX(i, k) = filter[std::min(
+                    (int) (std::abs(rel.x() + k - px) * lookupFactor), NORI_FILTER_RESOLUTION)];
+                weightsY(i, k) = filter[std::min(
+                    (int) (std::abs(rel.y() + k - py) * lookupFactor), NORI_FILTER_RESOLUTION)];
+            }
+            values.row(i) << value[start + i].r(), value[start + i].g(),
+                value[start + i].b(), 1.0f;
+        }
+
+        /* The footprint of each channel receives the sum of the outer
+           products of the samples' weights, i.e. WY^T * diag(c) * WX */
+        for (int c=0; c<4; ++c) {
+            scaled.noalias() = values.col(c).asDiagonal() * weightsX;
+            footprint.noalias() = weightsY.transpose() * scaled;
+            for (int y=0; y<width; ++y)
+                for (int x=0; x<width; ++x)
+                    coeffRef(rel.y() + y, rel.x() + x)[c] += footprint(y, x);
+        }
+    }
 }
-    
+
 void ImageBlock::put(ImageBlock &b) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
     Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
 
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Merge one stripe of rows at a time */
+    for (int y = offset.y(), end = offset.y() + size.y(); y < end; ) {
+        int stripe = y / NORI_BLOCK_STRIPE;
+        int rows = std::min(end, (stripe + 1) * NORI_BLOCK_STRIPE) - y;
+
+        tbb::mutex::scoped_lock lock(m_stripes[stripe]);
+        block(y, offset.x(), rows, size.x())
+            += b.block(y - offset.y(), 0, rows, size.x());
 
-    block(offset.y(), offset.x(), size.y(), size.x()) 
-        += b.topLeftCorner(size.y(), size.x());
+        /* Merge the statistics of the pixels (i.e. not the border) of
+           the stripe's rows */
+        if (!m_stats.empty() && !b.m_stats.empty()) {
+            for (int r = y; r < y + rows; ++r) {
+                int by = r - offset.y() - b.getBorderSize();
+                if (by < 0 || by >= b.getSize().y())
+                    continue;
+                PixelStatistics *dst = &m_stats[(r - m_borderSize) * m_statsStride
+                    + offset.x() + b.getBorderSize() - m_borderSize];
+                const PixelStatistics *src = &b.m_stats[by * b.m_statsStride];
+                for (int x=0; x<b.getSize().x(); ++x)
+                    dst[x].put(src[x]);
+            }
+        }
+        y += rows;
+    }
+}
+
+void ImageBlock::lock() const {
+    /* Always acquire the stripes in the same order */
+    for (int i=0; i<m_stripeCount; ++i)
+        m_stripes[i].lock();
+}
+
+void ImageBlock::unlock() const {
+    for (int i=m_stripeCount-1; i>=0; --i)
+        m_stripes[i].unlock();
 }
 
 std::string ImageBlock::toString() const {
@@ -106,48 +212,74 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
-    m_numBlocks = Vector2i(
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize, int splitCount)
+        : m_next(0) {
+    Vector2i numBlocks(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
-}
+    int blocksLeft = numBlocks.x() * numBlocks.y();
+    int direction = ERight, numSteps = 1, stepsLeft = 1;
+    Point2i block(numBlocks / 2);
 
-bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Walk along the spiral and record all blocks that lie in the image */
+    std::vector<Point2i> order;
+    order.reserve(blocksLeft);
+    while (true) {
+        order.push_back(block);
+        if (--blocksLeft == 0)
+            break;
 
-    if (m_blocksLeft == 0)
-        return false;
+        do {
+            switch (direction) {
+                case ERight: ++block.x(); break;
+                case EDown:  ++block.y(); break;
+                case ELeft:  --block.x(); break;
+                case EUp:    --block.y(); break;
+            }
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
-    block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
+            if (--stepsLeft == 0) {
+                direction = (direction + 1) % 4;
+                if (direction == ELeft || direction == ERight)
+                    ++numSteps;
+                stepsLeft = numSteps;
+            }
+        } while ((block.array() < 0).any() ||
+                 (block.array() >= numBlocks.array()).any());
+    }
 
-    if (--m_blocksLeft == 0)
-        return true;
+    /* Split the blocks at the end of the spiral into quarters */
+    int halfSize = (blockSize + 1) / 2;
+    if (blockSize < 2)
+        splitCount = 0;
+    size_t splitStart = order.size() - std::min((size_t) std::max(splitCount, 0), order.size());
 
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
+    m_blocks.reserve(splitStart + 4 * (order.size() - splitStart));
+    for (size_t i = 0; i < order.size(); ++i) {
+        Point2i pos = order[i] * blockSize;
+        Vector2i extent = (size - pos).cwiseMin(Vector2i::Constant(blockSize));
+
+        if (i < splitStart) {
+            m_blocks.push_back(Block { pos, extent });
+            continue;
         }
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
+        for (int y = 0; y < extent.y(); y += halfSize) {
+            for (int x = 0; x < extent.x(); x += halfSize) {
+                Point2i subPos = pos + Vector2i(x, y);
+                m_blocks.push_back(Block { subPos,
+                    (pos + extent - subPos).cwiseMin(Vector2i::Constant(halfSize)) });
+            }
         }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+    }
+}
+
+bool BlockGenerator::next(ImageBlock &block) {
+    int index = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= (int) m_blocks.size())
+        return false;
 
+    block.setOffset(m_blocks[index].offset);
+    block.setSize(m_blocks[index].size);
     return true;
 }
 
@@ -0,0 +1,103 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/block.h>
+#include <nori/rfilter.h>
+#include <nori/timer.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <memory>
+
+using namespace nori;
+
+/**
+ * Micro-benchmark of ImageBlock::put(ImageBlock &), which merges the
+ * image blocks rendered by the worker threads into the full-frame result.
+ *
+ * For an increasing number of threads, the blocks of a frame are merged
+ * repeatedly, once through the striped locks of the result block and
+ * once while holding a single global mutex (which is how merging worked
+ * before the locks were striped). No rendering takes place, so this
+ * measures the merge throughput alone.
+ */
+static double merge(ImageBlock &result, const ReconstructionFilter *filter,
+                    int threads, int iterations, bool globalLock) {
+    Vector2i size = result.getSize();
+    tbb::mutex mutex;
+    tbb::task_scheduler_init init(threads);
+
+    result.clear();
+    Timer timer;
+    for (int it=0; it<iterations; ++it) {
+        BlockGenerator blockGenerator(size, NORI_BLOCK_SIZE);
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, threads, 1),
+            [&](const tbb::blocked_range<int> &) {
+                ImageBlock block(Vector2i(NORI_BLOCK_SIZE), filter);
+                block.setConstant(Color4f(1.0f));
+
+                while (blockGenerator.next(block)) {
+                    if (globalLock) {
+                        tbb::mutex::scoped_lock lock(mutex);
+                        result.put(block);
+                    } else {
+                        result.put(block);
+                    }
+                }
+            }, tbb::simple_partitioner());
+    }
+    double seconds = timer.elapsed() / 1000.0;
+
+    BlockGenerator blockGenerator(size, NORI_BLOCK_SIZE);
+    return blockGenerator.getBlockCount() * (double) iterations / seconds;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 5) {
+        cerr << "Syntax: " << argv[0] << " [width height [iterations [maxThreads]]]" << endl;
+        return -1;
+    }
+
+    Vector2i size(1920, 1080);
+    int iterations = 200;
+    int maxThreads = tbb::task_scheduler_init::default_num_threads();
+    if (argc >= 3)
+        size = Vector2i(atoi(argv[1]), atoi(argv[2]));
+    if (argc >= 4)
+        iterations = atoi(argv[3]);
+    if (argc == 5)
+        maxThreads = atoi(argv[4]);
+    if ((size.array() <= 0).any() || iterations <= 0 || maxThreads <= 0) {
+        cerr << "Invalid arguments!" << endl;
+        return -1;
+    }
+
+    try {
+        std::unique_ptr<ReconstructionFilter> filter(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance("gaussian", PropertyList())));
+        filter->activate();
+        ImageBlock result(size, filter.get());
+
+        cout << tfm::format("Merging %ix%i blocks into a %ix%i image (%i iterations)",
+            NORI_BLOCK_SIZE, NORI_BLOCK_SIZE, size.x(), size.y(), iterations) << endl;
+        cout << "threads   global lock [blocks/s]   striped [blocks/s]   speedup" << endl;
+
+        for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            double global = merge(result, filter.get(), threads, iterations, true);
+            double striped = merge(result, filter.get(), threads, iterations, false);
+            cout << tfm::format("%7i   %22.0f   %18.0f   %7.2f", threads,
+                global, striped, striped / global) << endl;
+            if (threads == maxThreads)
+                break;
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <nori/object.h>
 #include <Eigen/Geometry>
 #include <Eigen/LU>
+#include <Eigen/SVD>
 #include <filesystem/resolver.h>
 #include <iomanip>
 
@@ -222,6 +223,67 @@ Transform Transform::operator*(const Transform &t) const {
         t.m_inverse * m_inverse);
 }
 
+void AnimatedTransform::addKeyframe(float time, const Transform &trafo) {
+    auto it = std::lower_bound(m_keyframes.begin(), m_keyframes.end(), time,
+        [](const std::pair<float, Transform> &keyframe, float time) {
+            return keyframe.first < time;
+        });
+    if (it != m_keyframes.end() && it->first == time)
+        it->second = trafo;
+    else
+        m_keyframes.insert(it, std::make_pair(time, trafo));
+}
+
+Transform AnimatedTransform::eval(float time) const {
+    if (m_keyframes.empty())
+        return Transform();
+
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+        [](float time, const std::pair<float, Transform> &keyframe) {
+            return time < keyframe.first;
+        });
+    if (it == m_keyframes.begin())
+        return it->second;
+    else if (it == m_keyframes.end())
+        return m_keyframes.back().second;
+
+    const std::pair<float, Transform> &k0 = *(it - 1), &k1 = *it;
+    if (time == k0.first)
+        return k0.second;
+
+    float alpha = (time - k0.first) / (k1.first - k0.first);
+
+    /* Decompose both keyframes into translation, rotation, and scaling */
+    Eigen::Affine3f a0(k0.second.getMatrix()), a1(k1.second.getMatrix());
+    Eigen::Matrix3f r0, s0, r1, s1;
+    a0.computeRotationScaling(&r0, &s0);
+    a1.computeRotationScaling(&r1, &s1);
+
+    Eigen::Quaternionf q = Eigen::Quaternionf(r0).slerp(alpha, Eigen::Quaternionf(r1));
+
+    Eigen::Affine3f result;
+    result.setIdentity();
+    result.linear() = q.toRotationMatrix() * ((1 - alpha) * s0 + alpha * s1);
+    result.translation() = (1 - alpha) * a0.translation() + alpha * a1.translation();
+
+    return Transform(result.matrix());
+}
+
+std::string AnimatedTransform::toString() const {
+    if (m_keyframes.size() <= 1)
+        return eval(0.0f).toString();
+
+    std::string result = "AnimatedTransform[\n";
+    for (size_t i = 0; i < m_keyframes.size(); ++i) {
+        std::string prefix = tfm::format("  %g: ", m_keyframes[i].first);
+        result += prefix + indent(m_keyframes[i].second.toString(), (int) prefix.size());
+        if (i + 1 < m_keyframes.size())
+            result += ",";
+        result += "\n";
+    }
+    return result + "]";
+}
+
 Vector3f sphericalDirection(float theta, float phi) {
     float sinTheta, cosTheta, sinPhi, cosPhi;
 
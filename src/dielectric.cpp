@@ -26,7 +26,7 @@ static Vector3f refract(const Vector3f &wi, const Normal3f &N, float extIOR, flo
 
 
 /// Ideal dielectric BSDF
-class Dielectric : public BSDF {
+class Dielectric : public TBSDF<Dielectric> {
 public:
     Dielectric(const PropertyList &propList) {
         /* Interior IOR (default: BK7 borosilicate optical glass) */
@@ -13,7 +13,7 @@ NORI_NAMESPACE_BEGIN
 /**
  * \brief Diffuse / Lambertian BRDF model
  */
-class Diffuse : public BSDF {
+class Diffuse : public TBSDF<Diffuse> {
 public:
     Diffuse(const PropertyList &propList) {
         m_albedo = propList.getColor("albedo", Color3f(0.5f));
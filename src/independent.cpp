@@ -29,14 +29,17 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_pass = m_pass;
+        cloned->m_sampleMap = m_sampleMap;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
     void prepare(const ImageBlock &block) {
+        /* Each pass of a progressive render uses different streams */
         m_random.seed(
             block.getOffset().x(),
-            block.getOffset().y()
+            block.getOffset().y() + ((uint64_t) m_pass << 32)
         );
     }
 
@@ -0,0 +1,140 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/sampler.h>
+#include <nori/block.h>
+
+/// Maximum number of samples of a pixel that are splatted together
+#define NORI_SPLAT_BATCH 64
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Version of \ref Integrator::renderBlock() that traces the camera rays of
+ * consecutive pixel samples as one packet (see \ref usesPrimaryPackets()).
+ * Packets span several pixels when there are few samples per pixel.
+ */
+static void renderBlockPackets(const Integrator *integrator, const Scene *scene,
+                               Sampler *sampler, ImageBlock &block) {
+    static_assert(NORI_SPLAT_BATCH % RayPacket8::Size == 0,
+                  "Splat batches must consist of whole packets");
+
+    const Camera *camera = scene->getCamera();
+
+    Point2i offset = block.getOffset();
+    Vector2i size  = block.getSize();
+
+    Point2f positions[NORI_SPLAT_BATCH];
+    Color3f values[NORI_SPLAT_BATCH];
+    RayPacket8 packet;
+    IntersectionPacket8 its;
+
+    /* The samples [first, batch) of the splat batch are in the packet */
+    size_t batch = 0, first = 0;
+
+    auto trace = [&]() {
+        scene->rayIntersect(packet, its);
+        for (int k=0; k<(int) (batch - first); ++k) {
+            Ray3f ray(packet.getRay(k));
+            values[first + k] *= integrator->LiPrimary(scene, sampler, ray,
+                its.valid[k] ? &its[k] : nullptr);
+        }
+        packet.active.setConstant(false);
+        first = batch;
+    };
+
+    for (int y=0; y<size.y(); ++y) {
+        for (int x=0; x<size.x(); ++x) {
+            size_t sampleCount = sampler->getPixelSampleCount(offset + Vector2i(x, y));
+            for (size_t i=0; i<sampleCount; ++i) {
+                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                /* Sample a ray from the camera */
+                Ray3f ray;
+                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+                /* Sample a time within the shutter interval */
+                if (scene->hasMotion())
+                    ray.time = sampler->next1D();
+
+                packet.setRay((int) (batch - first), ray);
+                positions[batch] = pixelSample;
+                values[batch] = value;
+                ++batch;
+
+                if (batch - first == RayPacket8::Size)
+                    trace();
+
+                if (batch == NORI_SPLAT_BATCH) {
+                    block.put(positions, values, batch);
+                    batch = first = 0;
+                }
+            }
+        }
+    }
+
+    if (batch > first)
+        trace();
+    if (batch > 0)
+        block.put(positions, values, batch);
+}
+
+void Integrator::renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) const {
+    const Camera *camera = scene->getCamera();
+
+    Point2i offset = block.getOffset();
+    Vector2i size  = block.getSize();
+
+    /* Clear the block contents */
+    block.clear();
+
+    if (usesPrimaryPackets()) {
+        renderBlockPackets(this, scene, sampler, block);
+        return;
+    }
+
+    /* The samples of a pixel are splatted together, in batches that
+       live on the stack (so that rendering doesn't allocate memory) */
+    Point2f positions[NORI_SPLAT_BATCH];
+    Color3f values[NORI_SPLAT_BATCH];
+
+    /* For each pixel and pixel sample sample */
+    for (int y=0; y<size.y(); ++y) {
+        for (int x=0; x<size.x(); ++x) {
+            size_t sampleCount = sampler->getPixelSampleCount(offset + Vector2i(x, y));
+            for (size_t i=0, batch=0; i<sampleCount; ++i) {
+                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                /* Sample a ray from the camera */
+                Ray3f ray;
+                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+                /* Sample a time within the shutter interval */
+                if (scene->hasMotion())
+                    ray.time = sampler->next1D();
+
+                /* Compute the incident radiance */
+                value *= Li(scene, sampler, ray);
+
+                positions[batch] = pixelSample;
+                values[batch] = value;
+
+                /* Store in the image block */
+                if (++batch == NORI_SPLAT_BATCH || i + 1 == sampleCount) {
+                    block.put(positions, values, batch);
+                    batch = 0;
+                }
+            }
+        }
+    }
+}
+
+NORI_NAMESPACE_END
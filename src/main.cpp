@@ -7,66 +7,99 @@
 #include <nori/parser.h>
 #include <nori/scene.h>
 #include <nori/camera.h>
+#include <nori/rfilter.h>
 #include <nori/block.h>
 #include <nori/timer.h>
 #include <nori/bitmap.h>
 #include <nori/sampler.h>
 #include <nori/integrator.h>
+#include <nori/adaptive.h>
 #include <nori/gui.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
 #include <thread>
+#include <limits>
 
 using namespace nori;
 
 static int threadCount = -1;
 static bool gui = true;
-
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
-    const Camera *camera = scene->getCamera();
-    const Integrator *integrator = scene->getIntegrator();
-
-    Point2i offset = block.getOffset();
-    Vector2i size  = block.getSize();
-
-    /* Clear the block contents */
-    block.clear();
-
-    /* For each pixel and pixel sample sample */
-    for (int y=0; y<size.y(); ++y) {
-        for (int x=0; x<size.x(); ++x) {
-            for (uint32_t i=0; i<sampler->getSampleCount(); ++i) {
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-                Point2f apertureSample = sampler->next2D();
-
-                /* Sample a ray from the camera */
-                Ray3f ray;
-                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
-
-                /* Compute the incident radiance */
-                value *= integrator->Li(scene, sampler, ray);
-
-                /* Store in the image block */
-                block.put(pixelSample, value);
-            }
-        }
+static bool progressive = false;
+static double timeBudget = 0;  /* Wall-clock budget per frame in seconds (0: none) */
+static int targetSpp = 0;      /* Samples per pixel of progressive renders (0: sampler's) */
+static float errorTarget = 0;  /* Relative error target of adaptive sampling (0: off) */
+
+/**
+ * \brief Rendering state of one worker thread
+ *
+ * Holds the image block that the worker renders into (which refers to
+ * the shared, tabulated reconstruction filter and owns the scratch
+ * space used for splatting) and the worker's clone of the
+ * sampler. Contexts are created once and then reused for all blocks
+ * and frames, so the render loop itself doesn't allocate memory.
+ */
+struct TileContext {
+    TileContext(const Scene *scene, const ReconstructionFilter *filter)
+        : block(Vector2i(NORI_BLOCK_SIZE), filter),
+          sampler(scene->getSampler()->clone()) { }
+
+    ImageBlock block;
+    std::unique_ptr<Sampler> sampler;
+};
+
+/// Parse a positive duration such as "500ms", "60s", "5m" or "1h" (default: seconds)
+static bool parseDuration(const std::string &str, double &seconds) {
+    size_t pos = 0;
+    try {
+        seconds = std::stod(str, &pos);
+    } catch (const std::exception &) {
+        return false;
     }
+
+    std::string unit = str.substr(pos);
+    if (unit == "ms")
+        seconds /= 1000;
+    else if (unit == "m" || unit == "min")
+        seconds *= 60;
+    else if (unit == "h")
+        seconds *= 3600;
+    else if (unit != "" && unit != "s")
+        return false;
+    return seconds > 0;
 }
 
 static void render(Scene *scene, const std::string &filename) {
     const Camera *camera = scene->getCamera();
     Vector2i outputSize = camera->getOutputSize();
-    scene->getIntegrator()->preprocess(scene);
 
-    /* Create a block generator (i.e. a work scheduler) */
-    BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+    /* Adaptive sampling gives neighboring pixels very different sample
+       counts. A filter that spans several pixels would then let densely
+       sampled pixels dominate their neighbors, which biases the edges
+       of converged regions, so each pixel is reconstructed from its own
+       samples instead (box filter) */
+    const ReconstructionFilter *filter = camera->getReconstructionFilter();
+    std::unique_ptr<ReconstructionFilter> boxFilter;
+    if (errorTarget > 0) {
+        boxFilter.reset(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance("box", PropertyList())));
+        boxFilter->activate();
+        filter = boxFilter.get();
+    }
 
     /* Allocate memory for the entire output image and clear it */
-    ImageBlock result(outputSize, camera->getReconstructionFilter());
+    ImageBlock result(outputSize, filter);
+    if (errorTarget > 0)
+        result.enableStatistics();
     result.clear();
 
+    /* Determine the filename of the output bitmap */
+    std::string outputName = filename;
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+
     /* Create a window that visualizes the partially rendered result */
     NoriScreen *screen = nullptr;
     if (gui) {
@@ -74,48 +107,176 @@ static void render(Scene *scene, const std::string &filename) {
         screen = new NoriScreen(result);
     }
 
-    /* Do the following in parallel and asynchronously */
+    /* Do the following in parallel and asynchronously. In animation
+       mode, the scene and the thread pool are reused for all frames */
     std::thread render_thread([&] {
         tbb::task_scheduler_init init(threadCount);
 
-        cout << "Rendering .. ";
-        cout.flush();
-        Timer timer;
-
-        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
-
-        auto map = [&](const tbb::blocked_range<int> &range) {
-            /* Allocate memory for a small image block to be rendered
-               by the current thread */
-            ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                camera->getReconstructionFilter());
+        /* Create one tile context per worker thread */
+        int workers = threadCount > 0 ? threadCount :
+            tbb::task_scheduler_init::default_num_threads();
+        std::vector<std::unique_ptr<TileContext>> contexts(workers);
+        for (auto &context : contexts)
+            context.reset(new TileContext(scene, filter));
+
+        /* Create a block generator (i.e. a work scheduler). The last
+           blocks are split so that no thread is left waiting for a slow
+           block. Their number is fixed, since the samplers are seeded
+           per block and the image shouldn't depend on the thread count */
+        BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE,
+            NORI_BLOCK_SPLIT_COUNT);
+
+        /* Adaptive sampling records per-pixel sample statistics and
+           plans the passes with a sample allocator */
+        std::unique_ptr<SampleAllocator> allocator;
+        if (errorTarget > 0) {
+            allocator.reset(new SampleAllocator(outputSize, errorTarget));
+            for (auto &context : contexts)
+                context->block.enableStatistics();
+        }
 
-            /* Create a clone of the sampler for the current thread */
-            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+        /* Render all blocks of the image once with the samplers' current
+           sample count (or sample map), and accumulate them into the result */
+        const SampleMap *passMap = nullptr;
+        auto renderPass = [&]() {
+            tbb::blocked_range<int> range(0, workers, 1);
+
+            auto map = [&](const tbb::blocked_range<int> &task) {
+                /* Each task owns one worker's tile context */
+                TileContext &context = *contexts[task.begin()];
+                ImageBlock &block = context.block;
+                Sampler *sampler = context.sampler.get();
+
+                /* Request image blocks from the block generator in spiral
+                   order until all of them have been handed out */
+                while (blockGenerator.next(block)) {
+                    /* Skip blocks whose pixels receive no samples in this pass */
+                    if (passMap && (passMap->block(block.getOffset().y(), block.getOffset().x(),
+                            block.getSize().y(), block.getSize().x()) == 0).all())
+                        continue;
+
+                    /* Inform the sampler about the block to be rendered */
+                    sampler->prepare(block);
+
+                    /* Render all contained pixels */
+                    scene->getIntegrator()->renderBlock(scene, sampler, block);
+
+                    /* The image block has been processed. Now add it to
+                       the "big" block that represents the entire image */
+                    result.put(block);
+                }
+            };
+
+            /// Default: parallel rendering (one task per worker thread)
+            blockGenerator.reset();
+            tbb::parallel_for(range, map, tbb::simple_partitioner());
+
+            /// (equivalent to the following single-threaded call)
+            // map(range);
+        };
 
-            for (int i=range.begin(); i<range.end(); ++i) {
-                /* Request an image block from the block generator */
-                blockGenerator.next(block);
+        for (int frame = scene->getFrameStart(); frame <= scene->getFrameEnd(); ++frame) {
+            std::string frameName = outputName;
+            if (scene->isAnimated()) {
+                cout << "Frame " << frame << " (of " << scene->getFrameStart()
+                     << ".." << scene->getFrameEnd() << ")" << endl;
+                scene->setFrame((float) frame);
+                frameName = tfm::format("%s_%04i", outputName, frame);
+                result.clear();
+            }
 
-                /* Inform the sampler about the block to be rendered */
-                sampler->prepare(block);
+            scene->getIntegrator()->preprocess(scene);
 
-                /* Render all contained pixels */
-                renderBlock(scene, sampler.get(), block);
+            cout << "Rendering .. ";
+            cout.flush();
+            Timer timer;
 
-                /* The image block has been processed. Now add it to
-                   the "big" block that represents the entire image */
-                result.put(block);
+            if (!progressive) {
+                renderPass();
+                cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            } else {
+                /* Render passes over the whole image that double the
+                   number of samples (1, 2, 4, .. per pixel) until the
+                   target is reached. With a time budget, the last pass is
+                   shortened to the number of samples that are expected to
+                   fit, and rendering stops once not even one sample per
+                   pixel does. When sampling adaptively, a few uniform
+                   passes are followed by passes that only sample the
+                   pixels whose error is above the target, until all of
+                   them have converged or the budget is used up */
+                size_t pixels = (size_t) outputSize.x() * (size_t) outputSize.y();
+                size_t target = scene->getSampler()->getSampleCount();
+                if (targetSpp > 0)
+                    target = (size_t) targetSpp;
+                else if (timeBudget > 0)
+                    target = std::numeric_limits<size_t>::max();
+                size_t budget = target == std::numeric_limits<size_t>::max() ?
+                    target : target * pixels;
+                size_t uniformSpp = allocator ?
+                    std::min(target, std::max((size_t) 2, std::min((size_t) 16, target / 4))) : target;
+                size_t done = 0;
+                cout << endl;
+
+                for (int pass = 0; done < budget; ++pass) {
+                    size_t count = std::min(std::max(done, pixels), budget - done);
+                    if (timeBudget > 0 && done > 0) {
+                        double perSample = std::max(timer.elapsed(), 1.0) / done;
+                        double remaining = timeBudget * 1000 - timer.elapsed();
+                        count = std::min(count, (size_t) std::max(remaining / perSample, 0.0));
+                    }
+
+                    size_t spp = 0;
+                    if (done / pixels < uniformSpp) {
+                        spp = std::min(count / pixels, uniformSpp - done / pixels);
+                        count = spp * pixels;
+                        passMap = nullptr;
+                    } else {
+                        count = allocator->plan(result, count);
+                        passMap = &allocator->getSampleMap();
+                        if (allocator->getActivePixels() == 0)
+                            cout << "  All pixels reached the error target." << endl;
+                    }
+                    if (count == 0)
+                        break;
+
+                    for (auto &context : contexts) {
+                        context->sampler->setPass(pass, spp);
+                        context->sampler->setSampleMap(passMap);
+                    }
+
+                    Timer passTimer;
+                    renderPass();
+                    done += count;
+                    if (!passMap)
+                        cout << tfm::format("  Pass %i: %i spp (%i spp total, took %s)",
+                            pass + 1, spp, done / pixels, passTimer.elapsedString()) << endl;
+                    else
+                        cout << tfm::format("  Pass %i: %i samples in %i pixels above the error target "
+                            "(%.1f spp total, took %s)", pass + 1, count, allocator->getActivePixels(),
+                            done / (double) pixels, passTimer.elapsedString()) << endl;
+                }
+
+                if (done % pixels == 0)
+                    cout << "done. (took " << timer.elapsedString() << ", "
+                         << done / pixels << " spp)" << endl;
+                else
+                    cout << tfm::format("done. (took %s, %.1f spp on average)",
+                        timer.elapsedString(), done / (double) pixels) << endl;
+
+                for (auto &context : contexts)
+                    context->sampler->setSampleMap(nullptr);
             }
-        };
 
-        /// Default: parallel rendering
-        tbb::parallel_for(range, map);
+            /* Now turn the rendered image block into
+               a properly normalized bitmap */
+            std::unique_ptr<Bitmap> bitmap(result.toBitmap());
 
-        /// (equivalent to the following single-threaded call)
-        // map(range);
+            /* Save using the OpenEXR format */
+            bitmap->saveEXR(frameName);
 
-        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            /* Save tonemapped (sRGB) output using the PNG format */
+            bitmap->savePNG(frameName);
+        }
     });
 
     /* Enter the application main loop */
@@ -129,27 +290,21 @@ static void render(Scene *scene, const std::string &filename) {
         delete screen;
         nanogui::shutdown();
     }
-
-    /* Now turn the rendered image block into
-       a properly normalized bitmap */
-    std::unique_ptr<Bitmap> bitmap(result.toBitmap());
-
-    /* Determine the filename of the output bitmap */
-    std::string outputName = filename;
-    size_t lastdot = outputName.find_last_of(".");
-    if (lastdot != std::string::npos)
-        outputName.erase(lastdot, std::string::npos);
-
-    /* Save using the OpenEXR format */
-    bitmap->saveEXR(outputName);
-
-    /* Save tonemapped (sRGB) output using the PNG format */
-    bitmap->savePNG(outputName);
 }
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]" <<  endl;
+        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N] "
+             << "[--progressive] [--spp N] [--time T] [--adaptive E]" <<  endl
+             << "  --no-gui       render without the preview window" << endl
+             << "  --threads N    render with N threads (default: one per core)" << endl
+             << "  --progressive  render in passes that double the samples per pixel" << endl
+             << "  --spp N        render progressively up to N samples per pixel" << endl
+             << "  --time T       render progressively for at most T (e.g. 500ms, 60s, 5m)" << endl
+             << "  --adaptive E   sample the pixels whose relative error is above E. Each pixel" << endl
+             << "                 is reconstructed from its own samples (box filter), since the" << endl
+             << "                 camera's filter would bias pixels next to more densely sampled" << endl
+             << "                 ones. The image is therefore slightly sharper and more aliased" << endl;
         return -1;
     }
 
@@ -176,6 +331,37 @@ int main(int argc, char **argv) {
             gui = false;
             continue;
         }
+        else if (token == "--progressive") {
+            progressive = true;
+            continue;
+        }
+        else if (token == "--spp") {
+            if (i+1 >= argc || (targetSpp = atoi(argv[i+1])) <= 0) {
+                cerr << "\"--spp\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--adaptive") {
+            if (i+1 >= argc || (errorTarget = (float) atof(argv[i+1])) <= 0) {
+                cerr << "\"--adaptive\" argument expects a positive relative error (e.g. 0.02) following it." << endl;
+                return -1;
+            }
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--time") {
+            if (i+1 >= argc || !parseDuration(argv[i+1], timeBudget)) {
+                cerr << "\"--time\" argument expects a duration (e.g. 500ms, 60s, 5m, 1h) following it." << endl;
+                return -1;
+            }
+            progressive = true;
+            i++;
+            continue;
+        }
 
         filesystem::path path(argv[i]);
 
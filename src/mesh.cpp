@@ -13,7 +13,8 @@
 
 NORI_NAMESPACE_BEGIN
 
-Mesh::Mesh() { }
+Mesh::Mesh() : m_V(nullptr, 3, 0), m_N(nullptr, 0, 0),
+    m_UV(nullptr, 0, 0), m_F(nullptr, 3, 0) { }
 
 Mesh::~Mesh() {
     delete m_bsdf;
@@ -27,11 +28,13 @@ void Mesh::activate() {
         m_bsdf = static_cast<BSDF *>(
             NoriObjectFactory::createInstance("diffuse", PropertyList()));
     }
+    if (m_emitter && hasMotion())
+        throw NoriException("Mesh: moving area emitters are not supported!");
     if (m_emitter) {
         /* If mesh has emitter, instantiate a discrete PDF */
-        m_dpdf = new DiscretePDF(m_F.cols());
+        m_dpdf = new DiscretePDF(getTriangleCount());
 
-        for(uint32_t i = 0; i < m_F.cols(); ++i) {
+        for(uint32_t i = 0; i < getTriangleCount(); ++i) {
             float area = surfaceArea(i);
             m_area += area;
             m_dpdf->append(area);
@@ -40,6 +43,162 @@ void Mesh::activate() {
     }
 }
 
+void Mesh::setVertexPositions(const MatrixXf &V) {
+    if (m_compressed)
+        throw NoriException("Mesh::setVertexPositions(): the mesh is compressed!");
+    if (V.rows() != 3 || V.cols() != m_V.cols())
+        throw NoriException("Mesh::setVertexPositions(): expected a 3x%i matrix!",
+                            m_V.cols());
+    m_VStorage = V;
+    setView(m_V, m_VStorage.data(), m_VStorage.rows(), m_VStorage.cols());
+    updateBoundingBox();
+
+    if (m_dpdf) {
+        /* The triangle areas of emitters changed as well */
+        m_dpdf->clear();
+        m_area = 0;
+        for (uint32_t i = 0; i < m_F.cols(); ++i) {
+            float area = surfaceArea(i);
+            m_area += area;
+            m_dpdf->append(area);
+        }
+        m_dpdf->normalize();
+    }
+}
+
+void Mesh::setVertexPositionsEnd(const MatrixXf &V, const MatrixXf &N) {
+    if (m_compressed)
+        throw NoriException("Mesh::setVertexPositionsEnd(): the mesh is compressed!");
+    if (V.size() > 0 && (V.rows() != 3 || V.cols() != m_V.cols()))
+        throw NoriException("Mesh::setVertexPositionsEnd(): expected a 3x%i matrix!",
+                            m_V.cols());
+    if (N.size() > 0 && (N.rows() != 3 || N.cols() != m_V.cols() || m_N.size() == 0))
+        throw NoriException("Mesh::setVertexPositionsEnd(): expected a 3x%i "
+                            "normal matrix (and normals at the start)!", m_V.cols());
+    m_VEnd = V;
+    m_NEnd = V.size() > 0 ? N : MatrixXf();
+    updateBoundingBox();
+}
+
+void Mesh::updateBoundingBox() {
+    m_bbox.reset();
+    for (uint32_t i = 0; i < getVertexCount(); ++i)
+        m_bbox.expandBy(getVertexPosition(i, 0.f));
+    for (uint32_t i = 0; i < (uint32_t) m_VEnd.cols(); ++i)
+        m_bbox.expandBy(Point3f(m_VEnd.col(i)));
+}
+
+void Mesh::updateViews() {
+    setView(m_V, m_VStorage.data(), m_VStorage.rows(), m_VStorage.cols());
+    setView(m_N, m_NStorage.data(), m_NStorage.rows(), m_NStorage.cols());
+    setView(m_UV, m_UVStorage.data(), m_UVStorage.rows(), m_UVStorage.cols());
+    setView(m_F, m_FStorage.data(), m_FStorage.rows(), m_FStorage.cols());
+}
+
+void Mesh::setVertexNormals(const MatrixXf &N) {
+    if (m_compressed)
+        throw NoriException("Mesh::setVertexNormals(): the mesh is compressed!");
+    if (N.size() > 0 && (N.rows() != 3 || N.cols() != m_V.cols()))
+        throw NoriException("Mesh::setVertexNormals(): expected a 3x%i matrix!",
+                            m_V.cols());
+    m_NStorage = N;
+    setView(m_N, m_NStorage.data(), m_NStorage.rows(), m_NStorage.cols());
+    if (N.size() == 0)
+        m_NEnd = MatrixXf();
+}
+
+/// Quantize a value in [0, 1] to 16 bits
+static uint16_t quantize(float value) {
+    return (uint16_t) std::round(std::min(std::max(value, 0.f), 1.f) * 65535.f);
+}
+
+void Mesh::compress() {
+    if (m_compressed)
+        return;
+    if (hasMotion())
+        throw NoriException("Mesh::compress(): moving meshes can't be compressed!");
+
+    uint32_t vertexCount = getVertexCount();
+
+    /* Positions relative to the bounding box */
+    Vector3f extents = Vector3f::Zero();
+    m_VOffset = Point3f::Zero();
+    if (vertexCount > 0) {
+        extents = m_bbox.getExtents();
+        m_VOffset = m_bbox.min;
+    }
+    m_VScale = extents / 65535.f;
+    m_VQuant.resize(3, vertexCount);
+    for (uint32_t i = 0; i < vertexCount; ++i)
+        for (int k = 0; k < 3; ++k)
+            m_VQuant(k, i) = extents[k] > 0 ?
+                quantize((m_V(k, i) - m_VOffset[k]) / extents[k]) : 0;
+
+    if (m_N.size() > 0) {
+        m_NQuant.resize(1, vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            m_NQuant(0, i) = encodeNormal(m_N.col(i));
+    }
+
+    /* Texture coordinates relative to their bounds */
+    if (m_UV.size() > 0) {
+        BoundingBox2f bounds;
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            bounds.expandBy(Point2f(m_UV.col(i)));
+        Vector2f uvExtents = bounds.getExtents();
+        m_UVOffset = bounds.min;
+        m_UVScale = uvExtents / 65535.f;
+        m_UVQuant.resize(2, vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            for (int k = 0; k < 2; ++k)
+                m_UVQuant(k, i) = uvExtents[k] > 0 ?
+                    quantize((m_UV(k, i) - m_UVOffset[k]) / uvExtents[k]) : 0;
+    }
+
+    /* Large meshes keep their 32-bit indices (which may be memory-mapped) */
+    if (vertexCount <= 65536) {
+        m_F16 = m_F.cast<uint16_t>();
+        m_FStorage = MatrixXu();
+        setView(m_F, m_FStorage.data(), 3, 0);
+    }
+
+    m_VStorage = MatrixXf();
+    m_NStorage = MatrixXf();
+    m_UVStorage = MatrixXf();
+    setView(m_V, m_VStorage.data(), 3, 0);
+    setView(m_N, m_NStorage.data(), 0, 0);
+    setView(m_UV, m_UVStorage.data(), 0, 0);
+    m_compressed = true;
+
+    /* Bound the decoded positions */
+    updateBoundingBox();
+}
+
+uint32_t Mesh::encodeNormal(const Normal3f &n) {
+    float length = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+    if (!(length > 0))
+        return 0;
+
+    /* Project onto the octahedron and fold the lower hemisphere */
+    float x = n.x() / length, y = n.y() / length;
+    if (n.z() < 0) {
+        float tx = x;
+        x = std::copysign(1.f - std::abs(y), tx);
+        y = std::copysign(1.f - std::abs(tx), y);
+    }
+
+    uint32_t qx = (uint16_t) (int16_t) std::round(std::min(std::max(x, -1.f), 1.f) * 32767.f),
+             qy = (uint16_t) (int16_t) std::round(std::min(std::max(y, -1.f), 1.f) * 32767.f);
+    return qx | (qy << 16);
+}
+
+size_t Mesh::getMemoryUsage() const {
+    return sizeof(float) * (m_V.size() + m_N.size() + m_UV.size() +
+                            m_VEnd.size() + m_NEnd.size()) +
+           sizeof(uint32_t) * (m_F.size() + m_NQuant.size()) +
+           sizeof(uint16_t) * (m_VQuant.size() + m_UVQuant.size() + m_F16.size());
+}
+
 void Mesh::sampleSurface(Sampler *sampler, Point3f &p, Normal3f &n) {
     uint32_t index = m_dpdf->sample(sampler->next1D());
     
@@ -49,18 +208,20 @@ void Mesh::sampleSurface(Sampler *sampler, Point3f &p, Normal3f &n) {
     float beta  = random.y() * sqrt(1.0f - random.x());
 
     // get triangle points
-    Point3f p0 = m_V.col(m_F(0, index)),
-            p1 = m_V.col(m_F(1, index)), 
-            p2 = m_V.col(m_F(2, index));
+    uint32_t i0 = getVertexIndex(index, 0), i1 = getVertexIndex(index, 1),
+             i2 = getVertexIndex(index, 2);
+    Point3f p0 = getVertexPosition(i0, 0.f),
+            p1 = getVertexPosition(i1, 0.f),
+            p2 = getVertexPosition(i2, 0.f);
     
     // get the interpolated points
     p = alpha * p0 + beta * p1 + (1.0f - alpha - beta) * p2;
 
     // get the interpolated normal
-    if(m_N.size() > 0) {
-        Normal3f n0 = m_N.col(m_F(0, index)),
-                 n1 = m_N.col(m_F(1, index)),
-                 n2 = m_N.col(m_F(2, index));
+    if(hasVertexNormals()) {
+        Normal3f n0 = getVertexNormal(i0, 0.f),
+                 n1 = getVertexNormal(i1, 0.f),
+                 n2 = getVertexNormal(i2, 0.f);
         n = (alpha * n0 + beta * n1 + (1.0f - alpha - beta) * n2).normalized();
     }
     else {
@@ -69,16 +230,17 @@ void Mesh::sampleSurface(Sampler *sampler, Point3f &p, Normal3f &n) {
 }
 
 float Mesh::surfaceArea(uint32_t index) const {
-    uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
-
-    const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
+    const Point3f p0 = getVertexPosition(getVertexIndex(index, 0), 0.f),
+                  p1 = getVertexPosition(getVertexIndex(index, 1), 0.f),
+                  p2 = getVertexPosition(getVertexIndex(index, 2), 0.f);
 
     return 0.5f * Vector3f((p1 - p0).cross(p2 - p0)).norm();
 }
 
 bool Mesh::rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
-    uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
-    const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
+    const Point3f p0 = getVertexPosition(getVertexIndex(index, 0), 0.f),
+                  p1 = getVertexPosition(getVertexIndex(index, 1), 0.f),
+                  p2 = getVertexPosition(getVertexIndex(index, 2), 0.f);
 
     /* Find vectors for two edges sharing v[0] */
     Vector3f edge1 = p1 - p0, edge2 = p2 - p0;
@@ -116,17 +278,21 @@ bool Mesh::rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, fl
 }
 
 BoundingBox3f Mesh::getBoundingBox(uint32_t index) const {
-    BoundingBox3f result(m_V.col(m_F(0, index)));
-    result.expandBy(m_V.col(m_F(1, index)));
-    result.expandBy(m_V.col(m_F(2, index)));
+    BoundingBox3f result(getVertexPosition(getVertexIndex(index, 0), 0.f));
+    result.expandBy(getVertexPosition(getVertexIndex(index, 1), 0.f));
+    result.expandBy(getVertexPosition(getVertexIndex(index, 2), 0.f));
+    if (m_VEnd.size() > 0) {
+        for (int k = 0; k < 3; ++k)
+            result.expandBy(m_VEnd.col(m_F(k, index)));
+    }
     return result;
 }
 
 Point3f Mesh::getCentroid(uint32_t index) const {
     return (1.0f / 3.0f) *
-        (m_V.col(m_F(0, index)) +
-         m_V.col(m_F(1, index)) +
-         m_V.col(m_F(2, index)));
+        (getVertexPosition(getVertexIndex(index, 0), 0.f) +
+         getVertexPosition(getVertexIndex(index, 1), 0.f) +
+         getVertexPosition(getVertexIndex(index, 2), 0.f));
 }
 
 void Mesh::addChild(NoriObject *obj) {
@@ -160,12 +326,14 @@ std::string Mesh::toString() const {
         "  name = \"%s\",\n"
         "  vertexCount = %i,\n"
         "  triangleCount = %i,\n"
+        "  compressed = %s,\n"
         "  bsdf = %s,\n"
         "  emitter = %s\n"
         "]",
         m_name,
-        m_V.cols(),
-        m_F.cols(),
+        getVertexCount(),
+        getTriangleCount(),
+        m_compressed ? "true" : "false",
         m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
         m_emitter ? indent(m_emitter->toString()) : std::string("null")
     );
@@ -27,7 +27,7 @@ static float g1(const Vector3f &wv, const Vector3f &wh, float alpha) {
     return b < 1.6f ? (3.535f * b + 2.181f * b * b) / (1.0f + 2.276f * b + 2.577f * b * b) : 1;
 }
 
-class Microfacet : public BSDF {
+class Microfacet : public TBSDF<Microfacet> {
 public:
     Microfacet(const PropertyList &propList) {
         /* RMS surface roughness */
@@ -99,7 +99,7 @@ public:
         // BRDF value divided by the solid angle density and multiplied by the
         // cosine factor from the reflection equation, i.e.
         // return eval(bRec) * Frame::cosTheta(bRec.wo) / pdf(bRec);
-        return eval(bRec) * Frame::cosTheta(bRec.wo) / pdf(bRec);
+        return Microfacet::eval(bRec) * Frame::cosTheta(bRec.wo) / Microfacet::pdf(bRec);
     }
 
     bool isDiffuse() const {
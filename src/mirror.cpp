@@ -10,7 +10,7 @@
 NORI_NAMESPACE_BEGIN
 
 /// Ideal mirror BRDF
-class Mirror : public BSDF {
+class Mirror : public TBSDF<Mirror> {
 public:
     Mirror(const PropertyList &) { }
 
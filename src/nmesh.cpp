@@ -0,0 +1,219 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/nmesh.h>
+#include <nori/mesh.h>
+#include <nori/mmap.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <fstream>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+static const char NoriMeshMagic[8] = "NORIMSH";
+
+bool NoriMeshHeader::getLayout(uint64_t offsets[4], uint64_t &fileSize) const {
+    /* Larger counts can't be indexed and would overflow the sizes below */
+    if (vertexCount > std::numeric_limits<uint32_t>::max() ||
+        triangleCount > std::numeric_limits<uint32_t>::max())
+        return false;
+
+    const uint64_t sizes[4] = {
+        3 * sizeof(float) * vertexCount,
+        (flags & EHasNormals) ? 3 * sizeof(float) * vertexCount : 0,
+        (flags & EHasTexCoords) ? 2 * sizeof(float) * vertexCount : 0,
+        3 * sizeof(uint32_t) * triangleCount
+    };
+
+    uint64_t offset = sizeof(NoriMeshHeader);
+    for (int i = 0; i < 4; ++i) {
+        offset = (offset + Alignment - 1) / Alignment * Alignment;
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+    fileSize = offset;
+    return true;
+}
+
+void writeNoriMesh(const Mesh *mesh, const filesystem::path &filename) {
+    if (mesh->isCompressed())
+        throw NoriException("writeNoriMesh(): compressed meshes are not supported!");
+
+    const MatrixXfView &V = mesh->getVertexPositions();
+    const MatrixXfView &N = mesh->getVertexNormals();
+    const MatrixXfView &UV = mesh->getVertexTexCoords();
+    const MatrixXuView &F = mesh->getIndices();
+    const BoundingBox3f &bbox = mesh->getBoundingBox();
+
+    NoriMeshHeader header;
+    memset(&header, 0, sizeof(NoriMeshHeader));
+    memcpy(header.magic, NoriMeshMagic, sizeof(header.magic));
+    header.version = NoriMeshHeader::Version;
+    header.flags = (N.size() > 0 ? NoriMeshHeader::EHasNormals : 0) |
+                   (UV.size() > 0 ? NoriMeshHeader::EHasTexCoords : 0);
+    header.vertexCount = (uint64_t) V.cols();
+    header.triangleCount = (uint64_t) F.cols();
+    for (int i = 0; i < 3; ++i) {
+        header.bboxMin[i] = bbox.min[i];
+        header.bboxMax[i] = bbox.max[i];
+    }
+
+    uint64_t offsets[4], fileSize;
+    if (!header.getLayout(offsets, fileSize))
+        throw NoriException("writeNoriMesh(): the mesh is too large!");
+
+    std::ofstream os(filename.str(), std::ios::binary);
+    if (os.fail())
+        throw NoriException("Unable to open \"%s\" for writing!", filename);
+
+    const char *data[4] = {
+        (const char *) V.data(), (const char *) N.data(),
+        (const char *) UV.data(), (const char *) F.data()
+    };
+    const uint64_t sizes[4] = {
+        sizeof(float) * (uint64_t) V.size(), sizeof(float) * (uint64_t) N.size(),
+        sizeof(float) * (uint64_t) UV.size(), sizeof(uint32_t) * (uint64_t) F.size()
+    };
+
+    os.write((const char *) &header, sizeof(NoriMeshHeader));
+    uint64_t offset = sizeof(NoriMeshHeader);
+    const char padding[NoriMeshHeader::Alignment] = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        if (sizes[i] == 0)
+            continue;
+        os.write(padding, (std::streamsize) (offsets[i] - offset));
+        os.write(data[i], (std::streamsize) sizes[i]);
+        offset = offsets[i] + sizes[i];
+    }
+
+    if (os.fail())
+        throw NoriException("Unable to write \"%s\"!", filename);
+}
+
+/**
+ * \brief Triangle mesh stored in a binary Nori mesh file
+ *
+ * The file is memory-mapped, and the mesh references its contents
+ * directly instead of reading them into memory. Loading is therefore
+ * fast, the operating system only keeps the parts of the mesh in memory
+ * that are actually used, and concurrent Nori processes share the same
+ * pages. By default, the BVH doesn't copy the triangles of mapped meshes
+ * either (see \ref Mesh::isMemoryMapped()), but its nodes and triangle
+ * references (roughly 20-40 bytes per triangle) must still fit into
+ * memory.
+ *
+ * The following properties are supported:
+ *
+ * <tt>filename</tt>: the binary mesh file (see \ref NoriMeshHeader)
+ *
+ * <tt>toWorld</tt>: transformation applied to the vertices. This copies
+ * the vertex positions and normals into memory (default: none)
+ *
+ * <tt>toWorldEnd</tt>: transformation at the end of the shutter interval
+ * for motion blur (default: none)
+ *
+ * <tt>compressed</tt>: store the mesh in compressed form (see
+ * \ref Mesh::compress()). This reads the whole file and keeps the
+ * compressed data in memory instead (default: \c false)
+ */
+class NoriMesh : public Mesh {
+public:
+    NoriMesh(const PropertyList &propList) {
+        filesystem::path filename =
+            getFileResolver()->resolve(propList.getString("filename"));
+
+        cout << "Mapping \"" << filename << "\" .. ";
+        cout.flush();
+        Timer timer;
+
+        m_file.reset(new MemoryMappedFile(filename));
+        const uint8_t *data = m_file->getData();
+
+        NoriMeshHeader header;
+        if (m_file->getSize() < sizeof(NoriMeshHeader))
+            throw NoriException("\"%s\" is not a binary Nori mesh!", filename);
+        memcpy(&header, data, sizeof(NoriMeshHeader));
+        if (memcmp(header.magic, NoriMeshMagic, sizeof(header.magic)) != 0)
+            throw NoriException("\"%s\" is not a binary Nori mesh!", filename);
+        if (header.version != NoriMeshHeader::Version)
+            throw NoriException("\"%s\" has an unsupported version (%i, expected %i)!",
+                                filename, header.version, (int) NoriMeshHeader::Version);
+
+        uint64_t offsets[4], fileSize;
+        if (!header.getLayout(offsets, fileSize))
+            throw NoriException("\"%s\" has too many vertices or triangles!", filename);
+        if (m_file->getSize() < fileSize)
+            throw NoriException("\"%s\" is truncated!", filename);
+
+        Eigen::Index vertexCount = (Eigen::Index) header.vertexCount;
+        setView(m_V, (const float *) (data + offsets[0]), 3, vertexCount);
+        if (header.flags & NoriMeshHeader::EHasNormals)
+            setView(m_N, (const float *) (data + offsets[1]), 3, vertexCount);
+        if (header.flags & NoriMeshHeader::EHasTexCoords)
+            setView(m_UV, (const float *) (data + offsets[2]), 2, vertexCount);
+        setView(m_F, (const uint32_t *) (data + offsets[3]), 3,
+                (Eigen::Index) header.triangleCount);
+
+        /* Out-of-range indices would make every user of the mesh read past
+           the mapped vertices. Checking them reads the triangles once */
+        if (m_F.size() > 0 && m_F.maxCoeff() >= header.vertexCount)
+            throw NoriException("\"%s\" contains out-of-range vertex indices!", filename);
+
+        /* Avoid touching all vertices just to compute the bounding box */
+        m_bbox = BoundingBox3f(
+            Point3f(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]),
+            Point3f(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]));
+
+        /* Transformations copy the affected data into memory */
+        const MatrixXfView V(m_V), N(m_N);
+        if (propList.has("toWorld")) {
+            transform(propList.getTransform("toWorld"), V, N, m_VStorage, m_NStorage);
+            setView(m_V, m_VStorage.data(), m_VStorage.rows(), m_VStorage.cols());
+            setView(m_N, m_NStorage.data(), m_NStorage.rows(), m_NStorage.cols());
+            updateBoundingBox();
+        }
+
+        if (propList.has("toWorldEnd")) {
+            MatrixXf VEnd, NEnd;
+            transform(propList.getTransform("toWorldEnd"), V, N, VEnd, NEnd);
+            setVertexPositionsEnd(VEnd, NEnd);
+        }
+
+        m_name = filename.str();
+        if (propList.getBoolean("compressed", false)) {
+            compress();
+            cout << "done. (V=" << getVertexCount() << ", F=" << getTriangleCount()
+                 << ", took " << timer.elapsedString() << " and "
+                 << memString(getMemoryUsage()) << " compressed)" << endl;
+        } else {
+            cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
+                 << timer.elapsedString() << " and " << memString(m_file->getSize())
+                 << " mapped)" << endl;
+        }
+    }
+
+    bool isMemoryMapped() const { return !isCompressed(); }
+
+protected:
+    /// Transform vertex positions and normals
+    static void transform(const Transform &trafo, const MatrixXfView &V,
+            const MatrixXfView &N, MatrixXf &VOut, MatrixXf &NOut) {
+        VOut.resize(3, V.cols());
+        for (Eigen::Index i = 0; i < V.cols(); ++i)
+            VOut.col(i) = trafo * Point3f(V.col(i));
+
+        NOut.resize(N.rows(), N.cols());
+        for (Eigen::Index i = 0; i < N.cols(); ++i)
+            NOut.col(i) = (trafo * Normal3f(N.col(i))).normalized();
+    }
+
+private:
+    std::unique_ptr<MemoryMappedFile> m_file;
+};
+
+NORI_REGISTER_CLASS(NoriMesh, "nmesh");
+NORI_NAMESPACE_END
@@ -12,13 +12,22 @@ public:
         Intersection its;
         if (!scene->rayIntersect(ray, its))
             return Color3f(0.0f);
+        return LiPrimary(scene, sampler, ray, &its);
+    }
+
+    Color3f LiPrimary(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                      const Intersection *its) const {
+        if (!its)
+            return Color3f(0.0f);
 
         /* Return the component-wise absolute
            value of the shading normal as a color */
-        Normal3f n = its.shFrame.n.cwiseAbs();
+        Normal3f n = its->shFrame.n.cwiseAbs();
         return Color3f(n.x(), n.y(), n.z());
     }
 
+    bool usesPrimaryPackets() const { return true; }
+
     std::string toString() const {
         return "NormalIntegrator[]";
     }
@@ -5,158 +5,513 @@
 */
 
 #include <nori/mesh.h>
+#include <nori/mmap.h>
 #include <nori/timer.h>
 #include <filesystem/resolver.h>
-#include <unordered_map>
-#include <fstream>
+#include <tbb/parallel_for.h>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
 /**
  * \brief Loader for Wavefront OBJ triangle meshes
+ *
+ * The file is memory-mapped and split into chunks at line boundaries,
+ * which are parsed in parallel without allocating memory per token.
+ * Each chunk deduplicates its face vertices using an open-addressing
+ * hash table; a second table then merges the chunks in file order, so
+ * the result is the same as when parsing the file sequentially.
+ *
+ * The following properties are supported:
+ *
+ * <tt>filename</tt>: the OBJ file
+ *
+ * <tt>toWorld</tt>: transformation applied to the vertices (default: none)
+ *
+ * <tt>toWorldEnd</tt>: transformation at the end of the shutter interval
+ * for motion blur (default: none)
+ *
+ * <tt>compressed</tt>: store the mesh in compressed form (see
+ * \ref Mesh::compress(), default: \c false)
+ *
+ * <tt>sequence</tt>: name pattern of OBJ files with the vertex positions
+ * (and normals) of the mesh in every frame of an animation, where
+ * <tt>\%i</tt> (or e.g. <tt>\%04i</tt>) stands for the frame number (see
+ * \ref Scene::setFrame()). The files must contain the same triangles
+ * as \c filename, which provides the mesh for frames without a file.
+ * Not supported together with \c toWorldEnd or \c compressed
+ * (default: none)
  */
 class WavefrontOBJ : public Mesh {
 public:
     WavefrontOBJ(const PropertyList &propList) {
-        typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
-
         filesystem::path filename =
             getFileResolver()->resolve(propList.getString("filename"));
+        m_trafo = propList.getTransform("toWorld", Transform());
 
-        std::ifstream is(filename.str());
-        if (is.fail())
-            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
-        Transform trafo = propList.getTransform("toWorld", Transform());
+        /* Optional rigid motion during the shutter interval */
+        bool motion = propList.has("toWorldEnd");
+        Transform trafoEnd = propList.getTransform("toWorldEnd", Transform());
+
+        /* Optional per-frame vertex positions */
+        m_sequence = propList.getString("sequence", "");
+        if (!m_sequence.empty() && m_sequence.find('%') == std::string::npos)
+            throw NoriException("The OBJ sequence \"%s\" lacks a frame number (e.g. %%04i)!",
+                                m_sequence);
+        if (!m_sequence.empty() && (motion || propList.getBoolean("compressed", false)))
+            throw NoriException("OBJ sequences can't be combined with motion blur or compression!");
+
+        cout << "Loading \"" << filename << "\" .. ";
+        cout.flush();
+        Timer timer;
+
+        OBJData data;
+        load(filename, m_trafo, motion ? &trafoEnd : nullptr, data);
+        m_VStorage = std::move(data.V);
+        m_NStorage = std::move(data.N);
+        m_UVStorage = std::move(data.UV);
+        m_FStorage = std::move(data.F);
+        m_VEnd = std::move(data.VEnd);
+        m_NEnd = std::move(data.NEnd);
+        m_bbox = data.bbox;
+
+        updateViews();
+        if (propList.getBoolean("compressed", false))
+            compress();
+
+        m_name = filename.str();
+        cout << "done. (V=" << getVertexCount() << ", F=" << getTriangleCount()
+             << ", took " << timer.elapsedString() << " and "
+             << memString(getMemoryUsage()) << ")" << endl;
+    }
+
+    bool isAnimated() const { return !m_sequence.empty(); }
+
+    void setFrame(float frame) {
+        if (m_sequence.empty())
+            return;
+
+        filesystem::path filename = getFileResolver()->resolve(
+            tfm::format(m_sequence.c_str(), (int) std::round(frame)));
+        if (filename == m_frameFilename || !filename.exists())
+            return;
 
         cout << "Loading \"" << filename << "\" .. ";
         cout.flush();
         Timer timer;
 
-        std::vector<Vector3f>   positions;
+        OBJData data;
+        load(filename, m_trafo, nullptr, data);
+        if (data.F != m_FStorage)
+            throw NoriException("The triangles of \"%s\" don't match those of \"%s\"!",
+                                filename, m_name);
+        setVertexPositions(data.V);
+        if (data.N.size() > 0 || m_N.size() > 0)
+            setVertexNormals(data.N);
+        m_frameFilename = filename;
+
+        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+    }
+
+protected:
+    /// Approximate number of bytes parsed by one task
+    static const size_t ChunkSize = 1 << 20;
+
+    /// Contents of an OBJ file
+    struct OBJData {
+        MatrixXf V, N, UV;  ///< Vertex positions, normals, and texture coordinates
+        MatrixXf VEnd, NEnd; ///< Positions and normals at the end of the shutter interval
+        MatrixXu F;         ///< Faces
+        BoundingBox3f bbox; ///< Bounds of all positions
+    };
+
+    /// Parse an OBJ file, optionally with motion blur (see the class description)
+    static void load(const filesystem::path &filename, const Transform &trafo,
+                     const Transform *trafoEnd, OBJData &data) {
+        std::unique_ptr<MemoryMappedFile> file;
+        try {
+            file.reset(new MemoryMappedFile(filename));
+        } catch (const NoriException &) {
+            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
+        }
+
+        /* Split the file into chunks that end at line boundaries */
+        const char *begin = (const char *) file->getData(),
+                   *end = begin + file->getSize();
+        std::vector<const char *> bounds(1, begin);
+        while (bounds.back() != end) {
+            const char *ptr = bounds.back() + std::min(
+                (size_t) (end - bounds.back()), ChunkSize);
+            while (ptr != end && *ptr++ != '\n')
+                ;
+            bounds.push_back(ptr);
+        }
+
+        /* Parse the chunks in parallel */
+        std::vector<OBJChunk> chunks(bounds.size() - 1);
+        tbb::parallel_for(size_t(0), chunks.size(), [&](size_t i) {
+            chunks[i].parse(bounds[i], bounds[i + 1], trafo, trafoEnd);
+        });
+
+        /* Concatenate the vertex attributes */
+        std::vector<Vector3f>   positions, positionsEnd;
         std::vector<Vector2f>   texcoords;
-        std::vector<Vector3f>   normals;
-        std::vector<uint32_t>   indices;
-        std::vector<OBJVertex>  vertices;
-        VertexMap vertexMap;
-
-        std::string line_str;
-        while (std::getline(is, line_str)) {
-            std::istringstream line(line_str);
-
-            std::string prefix;
-            line >> prefix;
-
-            if (prefix == "v") {
-                Point3f p;
-                line >> p.x() >> p.y() >> p.z();
-                p = trafo * p;
-                m_bbox.expandBy(p);
-                positions.push_back(p);
-            } else if (prefix == "vt") {
-                Point2f tc;
-                line >> tc.x() >> tc.y();
-                texcoords.push_back(tc);
-            } else if (prefix == "vn") {
-                Normal3f n;
-                line >> n.x() >> n.y() >> n.z();
-                normals.push_back((trafo * n).normalized());
-            } else if (prefix == "f") {
-                std::string v1, v2, v3, v4;
-                line >> v1 >> v2 >> v3 >> v4;
-                OBJVertex verts[6];
-                int nVertices = 3;
-
-                verts[0] = OBJVertex(v1);
-                verts[1] = OBJVertex(v2);
-                verts[2] = OBJVertex(v3);
-
-                if (!v4.empty()) {
-                    /* This is a quad, split into two triangles */
-                    verts[3] = OBJVertex(v4);
-                    verts[4] = verts[0];
-                    verts[5] = verts[2];
-                    nVertices = 6;
+        std::vector<Vector3f>   normals, normalsEnd;
+        for (const OBJChunk &chunk : chunks) {
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            positionsEnd.insert(positionsEnd.end(), chunk.positionsEnd.begin(), chunk.positionsEnd.end());
+            texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+            normalsEnd.insert(normalsEnd.end(), chunk.normalsEnd.begin(), chunk.normalsEnd.end());
+            data.bbox.expandBy(chunk.bbox);
+        }
+
+        /* Merge the unique vertices of all chunks (in order of their first use) */
+        std::vector<OBJVertex> vertices;
+        std::vector<size_t> indexOffset(chunks.size() + 1, 0);
+        OBJVertexMap vertexMap;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            OBJChunk &chunk = chunks[i];
+            chunk.remap.resize(chunk.vertices.size());
+            for (size_t j = 0; j < chunk.vertices.size(); ++j) {
+                const OBJVertex &v = chunk.vertices[j];
+                uint32_t index = vertexMap.insert(v, (uint32_t) vertices.size());
+                if (index == vertices.size()) {
+                    if (v.p == 0 || v.p > positions.size() ||
+                        (!texcoords.empty() && (v.uv == 0 || v.uv > texcoords.size())) ||
+                        (!normals.empty() && (v.n == 0 || v.n > normals.size())))
+                        throw NoriException("Invalid vertex index in OBJ file \"%s\"!", filename);
+                    vertices.push_back(v);
                 }
-                /* Convert to an indexed vertex list */
-                for (int i=0; i<nVertices; ++i) {
-                    const OBJVertex &v = verts[i];
-                    VertexMap::const_iterator it = vertexMap.find(v);
-                    if (it == vertexMap.end()) {
-                        vertexMap[v] = (uint32_t) vertices.size();
-                        indices.push_back((uint32_t) vertices.size());
-                        vertices.push_back(v);
-                    } else {
-                        indices.push_back(it->second);
+                chunk.remap[j] = index;
+            }
+            indexOffset[i + 1] = indexOffset[i] + chunk.indices.size();
+        }
+
+        data.F.resize(3, indexOffset.back() / 3);
+        tbb::parallel_for(size_t(0), chunks.size(), [&](size_t i) {
+            const OBJChunk &chunk = chunks[i];
+            uint32_t *F = data.F.data() + indexOffset[i];
+            for (size_t j = 0; j < chunk.indices.size(); ++j)
+                F[j] = chunk.remap[chunk.indices[j]];
+        });
+        chunks.clear();
+
+        uint32_t vertexCount = (uint32_t) vertices.size();
+        data.V.resize(3, vertexCount);
+        if (!normals.empty())
+            data.N.resize(3, vertexCount);
+        if (!texcoords.empty())
+            data.UV.resize(2, vertexCount);
+        if (trafoEnd) {
+            data.VEnd.resize(3, vertexCount);
+            if (!normals.empty())
+                data.NEnd.resize(3, vertexCount);
+        }
+
+        tbb::parallel_for(tbb::blocked_range<uint32_t>(0u, vertexCount, 4096),
+            [&](const tbb::blocked_range<uint32_t> &range) {
+                for (uint32_t i = range.begin(); i != range.end(); ++i) {
+                    const OBJVertex &v = vertices[i];
+                    data.V.col(i) = positions[v.p - 1];
+                    if (!normals.empty())
+                        data.N.col(i) = normals[v.n - 1];
+                    if (!texcoords.empty())
+                        data.UV.col(i) = texcoords[v.uv - 1];
+                    if (trafoEnd) {
+                        data.VEnd.col(i) = positionsEnd[v.p - 1];
+                        if (!normals.empty())
+                            data.NEnd.col(i) = normalsEnd[v.n - 1];
                     }
                 }
             }
+        );
+    }
+
+    /// Vertex indices used by the OBJ format (1-based, zero if missing)
+    struct OBJVertex {
+        uint32_t p = 0;
+        uint32_t n = 0;
+        uint32_t uv = 0;
+
+        inline bool operator==(const OBJVertex &v) const {
+            return v.p == p && v.n == n && v.uv == uv;
         }
+    };
 
-        m_F.resize(3, indices.size()/3);
-        memcpy(m_F.data(), indices.data(), sizeof(uint32_t)*indices.size());
+    /// Open-addressing hash table that maps OBJ vertices to their index
+    class OBJVertexMap {
+    public:
+        OBJVertexMap() : m_keys(64), m_values(64) { }
 
-        m_V.resize(3, vertices.size());
-        for (uint32_t i=0; i<vertices.size(); ++i)
-            m_V.col(i) = positions.at(vertices[i].p-1);
+        /**
+         * \brief Look up a vertex and insert it with the given index
+         * if it is not yet in the table
+         *
+         * \return The index of the vertex
+         */
+        uint32_t insert(const OBJVertex &v, uint32_t index) {
+            if (2 * (m_size + 1) > m_keys.size())
+                grow();
+            size_t mask = m_keys.size() - 1, slot = hash(v) & mask;
+            while (m_keys[slot].p != 0) {
+                if (m_keys[slot] == v)
+                    return m_values[slot];
+                slot = (slot + 1) & mask;
+            }
+            m_keys[slot] = v;
+            m_values[slot] = index;
+            m_size++;
+            return index;
+        }
 
-        if (!normals.empty()) {
-            m_N.resize(3, vertices.size());
-            for (uint32_t i=0; i<vertices.size(); ++i)
-                m_N.col(i) = normals.at(vertices[i].n-1);
+    private:
+        static size_t hash(const OBJVertex &v) {
+            uint64_t hash = v.p * 0x9E3779B97F4A7C15ull;
+            hash = (hash ^ (hash >> 29) ^ v.uv) * 0xBF58476D1CE4E5B9ull;
+            hash = (hash ^ (hash >> 32) ^ v.n) * 0x94D049BB133111EBull;
+            return (size_t) (hash ^ (hash >> 31));
         }
 
-        if (!texcoords.empty()) {
-            m_UV.resize(2, vertices.size());
-            for (uint32_t i=0; i<vertices.size(); ++i)
-                m_UV.col(i) = texcoords.at(vertices[i].uv-1);
+        void grow() {
+            std::vector<OBJVertex> keys(2 * m_keys.size());
+            std::vector<uint32_t> values(2 * m_keys.size());
+            size_t mask = keys.size() - 1;
+            for (size_t i = 0; i < m_keys.size(); ++i) {
+                if (m_keys[i].p == 0)
+                    continue;
+                size_t slot = hash(m_keys[i]) & mask;
+                while (keys[slot].p != 0)
+                    slot = (slot + 1) & mask;
+                keys[slot] = m_keys[i];
+                values[slot] = m_values[i];
+            }
+            m_keys.swap(keys);
+            m_values.swap(values);
         }
 
-        m_name = filename.str();
-        cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
-             << timer.elapsedString() << " and "
-             << memString(m_F.size() * sizeof(uint32_t) +
-                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
-             << ")" << endl;
-    }
+        std::vector<OBJVertex> m_keys; ///< Vertices (empty slots have p == 0)
+        std::vector<uint32_t> m_values;
+        size_t m_size = 0;
+    };
 
-protected:
-    /// Vertex indices used by the OBJ format
-    struct OBJVertex {
-        uint32_t p = (uint32_t) -1;
-        uint32_t n = (uint32_t) -1;
-        uint32_t uv = (uint32_t) -1;
+    /// Contents of a range of lines of the OBJ file
+    struct OBJChunk {
+        std::vector<Vector3f>   positions, positionsEnd;
+        std::vector<Vector2f>   texcoords;
+        std::vector<Vector3f>   normals, normalsEnd;
+        std::vector<OBJVertex>  vertices; ///< Unique face vertices of the chunk
+        std::vector<uint32_t>   indices;  ///< Triangles (indices into \c vertices)
+        std::vector<uint32_t>   remap;    ///< Index of each vertex in the mesh
+        BoundingBox3f           bbox;
 
-        inline OBJVertex() { }
+        void parse(const char *ptr, const char *end, const Transform &trafo,
+                   const Transform *trafoEnd) {
+            OBJVertexMap vertexMap;
 
-        inline OBJVertex(const std::string &string) {
-            std::vector<std::string> tokens = tokenize(string, "/", true);
+            while (ptr != end) {
+                const char *eol = ptr;
+                while (eol != end && *eol != '\n')
+                    ++eol;
+                const char *next = eol == end ? end : eol + 1;
 
-            if (tokens.size() < 1 || tokens.size() > 3)
-                throw NoriException("Invalid vertex data: \"%s\"", string);
+                ptr = skipSpace(ptr, eol);
+                const char *prefix = ptr;
+                while (ptr != eol && !isSpace(*ptr))
+                    ++ptr;
+                size_t length = ptr - prefix;
 
-            p = toUInt(tokens[0]);
+                if (length == 1 && prefix[0] == 'v') {
+                    Point3f p;
+                    parseFloats(ptr, eol, p.data(), 3);
+                    if (trafoEnd) {
+                        Point3f pEnd = *trafoEnd * p;
+                        bbox.expandBy(pEnd);
+                        positionsEnd.push_back(pEnd);
+                    }
+                    p = trafo * p;
+                    bbox.expandBy(p);
+                    positions.push_back(p);
+                } else if (length == 2 && prefix[0] == 'v' && prefix[1] == 't') {
+                    Point2f tc;
+                    parseFloats(ptr, eol, tc.data(), 2);
+                    texcoords.push_back(tc);
+                } else if (length == 2 && prefix[0] == 'v' && prefix[1] == 'n') {
+                    Normal3f n;
+                    parseFloats(ptr, eol, n.data(), 3);
+                    if (trafoEnd)
+                        normalsEnd.push_back((*trafoEnd * n).normalized());
+                    normals.push_back((trafo * n).normalized());
+                } else if (length == 1 && prefix[0] == 'f') {
+                    OBJVertex verts[6];
+                    int nVertices = 0;
 
-            if (tokens.size() >= 2 && !tokens[1].empty())
-                uv = toUInt(tokens[1]);
+                    /* Vertices beyond the fourth one are ignored */
+                    ptr = skipSpace(ptr, eol);
+                    while (ptr != eol && nVertices < 4) {
+                        verts[nVertices++] = parseVertex(ptr, eol);
+                        ptr = skipSpace(ptr, eol);
+                    }
+                    if (nVertices < 3)
+                        throw NoriException("Invalid face: \"%s\"",
+                                            std::string(prefix, eol));
 
-            if (tokens.size() >= 3 && !tokens[2].empty())
-                n = toUInt(tokens[2]);
-        }
+                    if (nVertices == 4) {
+                        /* This is a quad, split into two triangles */
+                        verts[4] = verts[0];
+                        verts[5] = verts[2];
+                        nVertices = 6;
+                    }
 
-        inline bool operator==(const OBJVertex &v) const {
-            return v.p == p && v.n == n && v.uv == uv;
+                    /* Convert to an indexed vertex list */
+                    for (int i=0; i<nVertices; ++i) {
+                        uint32_t index = vertexMap.insert(
+                            verts[i], (uint32_t) vertices.size());
+                        if (index == vertices.size())
+                            vertices.push_back(verts[i]);
+                        indices.push_back(index);
+                    }
+                }
+
+                ptr = next;
+            }
         }
     };
 
-    /// Hash function for OBJVertex
-    struct OBJVertexHash {
-        std::size_t operator()(const OBJVertex &v) const {
-            size_t hash = std::hash<uint32_t>()(v.p);
-            hash = hash * 37 + std::hash<uint32_t>()(v.uv);
-            hash = hash * 37 + std::hash<uint32_t>()(v.n);
-            return hash;
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static const char *skipSpace(const char *ptr, const char *end) {
+        while (ptr != end && isSpace(*ptr))
+            ++ptr;
+        return ptr;
+    }
+
+    /// Parse the given number of whitespace-separated floats (missing values are zero)
+    static void parseFloats(const char *&ptr, const char *end, float *values, int count) {
+        for (int i = 0; i < count; ++i) {
+            ptr = skipSpace(ptr, end);
+            if (!parseFloat(ptr, end, values[i]))
+                values[i] = 0.f;
         }
-    };
+    }
+
+    /**
+     * \brief Parse a floating point value without allocating memory
+     *
+     * Values with few significant digits (i.e. virtually all values in
+     * OBJ files) are converted using a single correctly rounded division
+     * or multiplication. Others are passed on to \c strtof(). Both produce
+     * the float closest to the decimal value.
+     */
+    static bool parseFloat(const char *&ptr, const char *end, float &value) {
+        static const float powers[] = {
+            1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+        };
+
+        const char *start = ptr;
+        bool negative = false;
+        if (ptr != end && (*ptr == '-' || *ptr == '+'))
+            negative = *ptr++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool valid = false;
+        for (; ptr != end && isDigit(*ptr); ++ptr) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t) (*ptr - '0');
+                digits += mantissa != 0;
+            } else {
+                exponent++;
+            }
+            valid = true;
+        }
+        if (ptr != end && *ptr == '.') {
+            for (++ptr; ptr != end && isDigit(*ptr); ++ptr) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (uint64_t) (*ptr - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+                valid = true;
+            }
+        }
+        if (!valid) {
+            ptr = start;
+            return false;
+        }
+        if (ptr != end && (*ptr == 'e' || *ptr == 'E')) {
+            const char *exp = ptr + 1;
+            bool expNegative = false;
+            if (exp != end && (*exp == '-' || *exp == '+'))
+                expNegative = *exp++ == '-';
+            if (exp != end && isDigit(*exp)) {
+                int e = 0;
+                for (; exp != end && isDigit(*exp); ++exp)
+                    e = std::min(e * 10 + (*exp - '0'), 100000);
+                exponent += expNegative ? -e : e;
+                ptr = exp;
+            }
+        }
+
+        if (mantissa < (1u << 24) && exponent >= -10 && exponent <= 10) {
+            /* Both operands are exactly representable */
+            float result = (float) mantissa;
+            result = exponent < 0 ? result / powers[-exponent]
+                                  : result * powers[exponent];
+            value = negative ? -result : result;
+            return true;
+        }
+
+        char buf[128];
+        size_t length = std::min((size_t) (ptr - start), sizeof(buf) - 1);
+        memcpy(buf, start, length);
+        buf[length] = '\0';
+        value = strtof(buf, nullptr);
+        return true;
+    }
+
+    /// Parse an unsigned integer without allocating memory
+    static bool parseUInt(const char *&ptr, const char *end, uint32_t &value) {
+        if (ptr == end || !isDigit(*ptr))
+            return false;
+        uint64_t result = 0;
+        for (; ptr != end && isDigit(*ptr); ++ptr)
+            result = std::min(result * 10 + (uint64_t) (*ptr - '0'), (uint64_t) UINT32_MAX);
+        value = (uint32_t) result;
+        return true;
+    }
+
+    /// Parse a face vertex of the form <tt>p</tt>, <tt>p/uv</tt>, <tt>p//n</tt>, or <tt>p/uv/n</tt>
+    static OBJVertex parseVertex(const char *&ptr, const char *end) {
+        const char *start = ptr;
+        OBJVertex v;
+        bool valid = parseUInt(ptr, end, v.p);
+        if (valid && ptr != end && *ptr == '/') {
+            ++ptr;
+            parseUInt(ptr, end, v.uv);
+            if (ptr != end && *ptr == '/') {
+                ++ptr;
+                valid = parseUInt(ptr, end, v.n);
+            }
+        }
+        if (!valid || v.p == 0 || (ptr != end && !isSpace(*ptr))) {
+            while (ptr != end && !isSpace(*ptr))
+                ++ptr;
+            throw NoriException("Invalid vertex data: \"%s\"", std::string(start, ptr));
+        }
+        return v;
+    }
+
+private:
+    Transform m_trafo;                ///< Transformation applied to the vertices
+    std::string m_sequence;           ///< Name pattern of the per-frame OBJ files
+    filesystem::path m_frameFilename; ///< OBJ file of the current frame
 };
 
 NORI_REGISTER_CLASS(WavefrontOBJ, "obj");
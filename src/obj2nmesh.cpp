@@ -0,0 +1,43 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/nmesh.h>
+#include <nori/mesh.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <memory>
+
+using namespace nori;
+
+/* Convert a Wavefront OBJ file into a binary Nori mesh (see NoriMeshHeader) */
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        cerr << "Syntax: " << argv[0] << " <input.obj> <output.nmesh>" << endl;
+        return -1;
+    }
+
+    try {
+        /* The OBJ loader resolves (relative) names using the file resolver */
+        filesystem::path input(argv[1]);
+        getFileResolver()->prepend(input.parent_path());
+
+        PropertyList propList;
+        propList.setString("filename", input.filename());
+        std::unique_ptr<NoriObject> mesh(
+            NoriObjectFactory::createInstance("obj", propList));
+
+        cout << "Writing \"" << argv[2] << "\" .. ";
+        cout.flush();
+        Timer timer;
+        writeNoriMesh(static_cast<const Mesh *>(mesh.get()), argv[2]);
+        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
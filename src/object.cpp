@@ -15,6 +15,7 @@ void NoriObject::addChild(NoriObject *) {
 }
 
 void NoriObject::activate() { /* Do nothing */ }
+void NoriObject::setFrame(float) { /* Do nothing */ }
 void NoriObject::setParent(NoriObject *) { /* Do nothing */ }
 
 std::map<std::string, NoriObjectFactory::Constructor> *NoriObjectFactory::m_constructors = nullptr;
@@ -55,6 +55,7 @@ NoriObject *loadFromXML(const std::string &filename) {
         ESampler              = NoriObject::ESampler,
         ETest                 = NoriObject::ETest,
         EReconstructionFilter = NoriObject::EReconstructionFilter,
+        EInstance             = NoriObject::EInstance,
 
         /* Properties */
         EBoolean = NoriObject::EClassTypeCount,
@@ -87,6 +88,7 @@ NoriObject *loadFromXML(const std::string &filename) {
     tags["sampler"]    = ESampler;
     tags["rfilter"]    = EReconstructionFilter;
     tags["test"]       = ETest;
+    tags["instance"]   = EInstance;
     tags["boolean"]    = EBoolean;
     tags["integer"]    = EInteger;
     tags["float"]      = EFloat;
@@ -117,6 +119,9 @@ NoriObject *loadFromXML(const std::string &filename) {
 
     Eigen::Affine3f transform;
 
+    /* Objects with an 'id' attribute, which can be referenced by instances */
+    std::map<std::string, NoriObject *> ids;
+
     /* Helper function to parse a Nori XML node (recursive) */
     std::function<NoriObject *(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
         pugi::xml_node &node, PropertyList &list, int parentTag) -> NoriObject * {
@@ -158,6 +163,8 @@ NoriObject *loadFromXML(const std::string &filename) {
 
         if (tag == EScene)
             node.append_attribute("type") = "scene";
+        else if (tag == EInstance)
+            node.append_attribute("type") = "instance";
         else if (tag == ETransform)
             transform.setIdentity();
 
@@ -172,7 +179,12 @@ NoriObject *loadFromXML(const std::string &filename) {
         NoriObject *result = nullptr;
         try {
             if (currentIsObject) {
-                check_attributes(node, { "type" });
+                std::set<std::string> attrs = { "type" };
+                if (tag == EInstance)
+                    attrs.insert("ref");
+                else if (node.attribute("id"))
+                    attrs.insert("id");
+                check_attributes(node, attrs);
 
                 /* This is an object, first instantiate it */
                 result = NoriObjectFactory::createInstance(
@@ -189,6 +201,16 @@ NoriObject *loadFromXML(const std::string &filename) {
                         result->toString());
                 }
 
+                /* Instances refer to a previously declared object,
+                   which remains a child of its original parent */
+                if (tag == EInstance) {
+                    auto it = ids.find(node.attribute("ref").value());
+                    if (it == ids.end())
+                        throw NoriException("Unknown reference \"%s\"",
+                                            node.attribute("ref").value());
+                    result->addChild(it->second);
+                }
+
                 /* Add all children */
                 for (auto ch: children) {
                     result->addChild(ch);
@@ -197,6 +219,13 @@ NoriObject *loadFromXML(const std::string &filename) {
 
                 /* Activate / configure the object */
                 result->activate();
+
+                if (node.attribute("id")) {
+                    std::string id = node.attribute("id").value();
+                    if (ids.find(id) != ids.end())
+                        throw NoriException("Duplicate id \"%s\"", id);
+                    ids[id] = result;
+                }
             } else {
                 /* This is a property */
                 switch (tag) {
@@ -236,8 +265,15 @@ NoriObject *loadFromXML(const std::string &filename) {
                         }
                         break;
                     case ETransform: {
-                            check_attributes(node, { "name" });
-                            list.setTransform(node.attribute("name").value(), transform.matrix());
+                            if (node.attribute("frame")) {
+                                /* Keyframe of an animated transformation */
+                                check_attributes(node, { "name", "frame" });
+                                list.addTransformKeyframe(node.attribute("name").value(),
+                                    toFloat(node.attribute("frame").value()), transform.matrix());
+                            } else {
+                                check_attributes(node, { "name" });
+                                list.setTransform(node.attribute("name").value(), transform.matrix());
+                            }
                         }
                         break;
                     case ETranslate: {
@@ -29,6 +29,7 @@ public:
                 float sampleEmitterPdf = scene->sampleEmitterPdf();
                 EmitterQueryRecord eRec(its.p);
                 Color3f emission = emitter->sample(eRec, sampler);
+                eRec.shadowRay.time = ray.time;
                 if (scene->rayIntersect(eRec.shadowRay)) {
                     emission = 0.0f;
                 }
@@ -51,6 +52,7 @@ public:
             BSDFQueryRecord bRec(its.toLocal(-r.d));
             Color3f fr = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
             r = Ray3f(its.p, its.toWorld(bRec.wo));
+            r.time = ray.time;
             t *= fr;
             ++depth;
         }
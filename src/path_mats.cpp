@@ -33,6 +33,7 @@ public:
             BSDFQueryRecord bRec(its.toLocal(-r.d));
             Color3f fr = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
             r = Ray3f(its.p, its.toWorld(bRec.wo));
+            r.time = ray.time;
             t *= fr;
             ++depth;
         }
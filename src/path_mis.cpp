@@ -29,6 +29,7 @@ public:
             EmitterQueryRecord eRec(its.p);
             Color3f emission = emitter->sample(eRec, sampler);
             float pdf_ems = emitter->pdf(eRec);
+            eRec.shadowRay.time = ray.time;
             if (!scene->rayIntersect(eRec.shadowRay)) {
                 float cosTheta = fabs(Frame::cosTheta(its.toLocal(-eRec.wi)));
                 BSDFQueryRecord bRec(its.toLocal(-r.d), its.toLocal(-eRec.wi), ESolidAngle);
@@ -59,6 +60,7 @@ public:
             Color3f fr = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
             float pdf_mats = its.mesh->getBSDF()->pdf(bRec);
             r = Ray3f(its.p, its.toWorld(bRec.wo));
+            r.time = ray.time;
             Intersection its2;
             if (scene->rayIntersect(r, its2)) {
                 if (its2.mesh->isEmitter()) {
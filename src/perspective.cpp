@@ -25,8 +25,9 @@ public:
         m_outputSize.y() = propList.getInteger("height", 720);
         m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
-        /* Specifies an optional camera-to-world transformation. Default: none */
-        m_cameraToWorld = propList.getTransform("toWorld", Transform());
+        /* Specifies an optional (possibly keyframed) camera-to-world transformation. Default: none */
+        m_cameraToWorldAnim = propList.getAnimatedTransform("toWorld", AnimatedTransform());
+        m_cameraToWorld = m_cameraToWorldAnim.eval(0.0f);
 
         /* Horizontal field of view in degrees */
         m_fov = propList.getFloat("fov", 30.0f);
@@ -68,9 +69,11 @@ public:
             Eigen::Translation<float, 3>(-1.0f, -1.0f/aspect, 0.0f) * perspective).inverse();
 
         /* If no reconstruction filter was assigned, instantiate a Gaussian filter */
-        if (!m_rfilter)
+        if (!m_rfilter) {
             m_rfilter = static_cast<ReconstructionFilter *>(
                 NoriObjectFactory::createInstance("gaussian", PropertyList()));
+            m_rfilter->activate();
+        }
     }
 
     Color3f sampleRay(Ray3f &ray,
@@ -96,6 +99,11 @@ public:
         return Color3f(1.0f);
     }
 
+    void setFrame(float frame) {
+        if (m_cameraToWorldAnim.isAnimated())
+            m_cameraToWorld = m_cameraToWorldAnim.eval(frame);
+    }
+
     void addChild(NoriObject *obj) {
         switch (obj->getClassType()) {
             case EReconstructionFilter:
@@ -120,7 +128,7 @@ public:
             "  clip = [%f, %f],\n"
             "  rfilter = %s\n"
             "]",
-            indent(m_cameraToWorld.toString(), 18),
+            indent(m_cameraToWorldAnim.toString(), 18),
             m_outputSize.toString(),
             m_fov,
             m_nearClip,
@@ -132,6 +140,7 @@ private:
     Vector2f m_invOutputSize;
     Transform m_sampleToCamera;
     Transform m_cameraToWorld;
+    AnimatedTransform m_cameraToWorldAnim;
     float m_fov;
     float m_nearClip;
     float m_farClip;
@@ -46,5 +46,37 @@ DEFINE_PROPERTY_ACCESSOR(Vector3f, Vector, vector)
 DEFINE_PROPERTY_ACCESSOR(std::string, String, string)
 DEFINE_PROPERTY_ACCESSOR(Transform, Transform, transform)
 
+void PropertyList::addTransformKeyframe(const std::string &name, float time, const Transform &value) {
+    auto it = m_properties.find(name);
+    if (it != m_properties.end() && it->second.type != Property::animated_transform_type)
+        cerr << "Property \"" << name <<  "\" was specified multiple times!" << endl;
+    auto &prop = m_properties[name];
+    if (prop.type != Property::animated_transform_type) {
+        prop.value.animated_transform_value = AnimatedTransform();
+        prop.type = Property::animated_transform_type;
+    }
+    prop.value.animated_transform_value.addKeyframe(time, value);
+}
+
+AnimatedTransform PropertyList::getAnimatedTransform(const std::string &name) const {
+    auto it = m_properties.find(name);
+    if (it == m_properties.end())
+        throw NoriException("Property '%s' is missing!", name);
+    return getAnimatedTransform(name, AnimatedTransform());
+}
+
+AnimatedTransform PropertyList::getAnimatedTransform(const std::string &name,
+        const AnimatedTransform &defVal) const {
+    auto it = m_properties.find(name);
+    if (it == m_properties.end())
+        return defVal;
+    if (it->second.type == Property::transform_type)
+        return AnimatedTransform(it->second.value.transform_value);
+    if (it->second.type != Property::animated_transform_type)
+        throw NoriException("Property '%s' has the wrong type! "
+            "(expected <transform>)!", name);
+    return it->second.value.animated_transform_value;
+}
+
 NORI_NAMESPACE_END
 
@@ -8,6 +8,18 @@
 
 NORI_NAMESPACE_BEGIN
 
+void ReconstructionFilter::activate() {
+    /* Tabulate the image reconstruction filter for performance reasons */
+    m_table.radius = m_radius;
+    m_table.borderSize = (int) std::ceil(m_radius - 0.5f);
+    for (int i=0; i<NORI_FILTER_RESOLUTION; ++i) {
+        float pos = (m_radius * i) / NORI_FILTER_RESOLUTION;
+        m_table.values[i] = eval(pos);
+    }
+    m_table.values[NORI_FILTER_RESOLUTION] = 0.0f;
+    m_table.lookupFactor = NORI_FILTER_RESOLUTION / m_radius;
+}
+
 /**
  * Windowed Gaussian filter with configurable extent
  * and standard deviation. Often produces pleasing 
@@ -10,27 +10,44 @@
 #include <nori/sampler.h>
 #include <nori/camera.h>
 #include <nori/emitter.h>
+#include <nori/instance.h>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
-    m_accel = new Accel();
+Scene::Scene(const PropertyList &propList) {
+    m_accel = new Accel(propList);
+
+    /* Range of frames rendered in animation mode */
+    m_frameStart = propList.getInteger("frameStart", 0);
+    m_frameEnd = propList.getInteger("frameEnd", m_frameStart);
+    if (m_frameEnd < m_frameStart)
+        throw NoriException("Scene: the last frame precedes the first one!");
 }
 
 Scene::~Scene() {
     delete m_accel;
+    for (auto instance : m_instances)
+        delete instance;
     delete m_sampler;
     delete m_camera;
     delete m_integrator;
 }
 
 void Scene::activate() {
+    for (auto mesh : m_meshes)
+        mesh->setFrame((float) m_frameStart);
+    for (auto instance : m_instances)
+        instance->setFrame((float) m_frameStart);
+
     m_accel->build();
 
     if (!m_integrator)
         throw NoriException("No integrator was specified!");
     if (!m_camera)
         throw NoriException("No camera was specified!");
+
+    m_camera->setFrame((float) m_frameStart);
+    m_frame = (float) m_frameStart;
     
     if (!m_sampler) {
         /* Create a default (independent) sampler */
@@ -49,11 +66,19 @@ void Scene::addChild(NoriObject *obj) {
                 Mesh *mesh = static_cast<Mesh *>(obj);
                 m_accel->addMesh(mesh);
                 m_meshes.push_back(mesh);
+                m_motion |= mesh->hasMotion();
                 if (mesh->isEmitter())
                     m_emitters.push_back(mesh->getEmitter());
             }
             break;
         
+        case EInstance: {
+                Instance *instance = static_cast<Instance *>(obj);
+                m_accel->addInstance(instance);
+                m_instances.push_back(instance);
+            }
+            break;
+
         case EEmitter: {
                 // Emitter *emitter = static_cast<Emitter *>(obj);
                 /* TBD */
@@ -85,6 +110,37 @@ void Scene::addChild(NoriObject *obj) {
     }
 }
 
+void Scene::setFrame(float frame) {
+    /* Everything was already moved to the first frame in activate() */
+    if (frame == m_frame)
+        return;
+    m_frame = frame;
+
+    m_camera->setFrame(frame);
+
+    bool deformed = false;
+    for (auto mesh : m_meshes) {
+        if (mesh->isAnimated()) {
+            mesh->setFrame(frame);
+            deformed = true;
+        }
+    }
+
+    bool moved = false;
+    for (auto instance : m_instances) {
+        if (instance->isAnimated()) {
+            instance->setFrame(frame);
+            moved = true;
+        }
+    }
+
+    /* Refitting also rebuilds the top-level BVH over instances */
+    if (deformed)
+        m_accel->refit();
+    else if (moved)
+        m_accel->updateInstances();
+}
+
 Emitter *Scene::sampleEmitter(Sampler *sampler) const {
     if (m_emitters.size() == 0)
         throw NoriException("m_emitters.size() == 0");
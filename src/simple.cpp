@@ -18,22 +18,33 @@ public:
         Intersection its;
         if (!scene->rayIntersect(ray, its))
             return Color3f(0.0f);
-        Point3f p = its.p;
+        return LiPrimary(scene, sampler, ray, &its);
+    }
+
+    Color3f LiPrimary(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                      const Intersection *its) const {
+        if (!its)
+            return Color3f(0.0f);
+        Point3f p = its->p;
         Point3f x = position;
-        Normal3f n = its.shFrame.n;
+        Normal3f n = its->shFrame.n;
         float visible = 1.0f;
         Vector3f wi = (x - p).normalized();
         /**
          * shadowRay to check whether an intersection exists 
          * rather than having to find the closest one.
         */
-        if (scene->rayIntersect(Ray3f(p, wi)))  
+        Ray3f shadowRay(p, wi);
+        shadowRay.time = ray.time;
+        if (scene->rayIntersect(shadowRay))  
             visible = 0.0f;
         float dis = (x - p).dot(x - p);
         Color3f Li = energy * INV_FOURPI * INV_PI * std::max(0.0f, n.dot(wi)) / dis * visible;
         return Li;
     }
 
+    bool usesPrimaryPackets() const { return true; }
+
     std::string toString() const {
         return "SimpleIntegrator[]";
     }
@@ -0,0 +1,294 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/trianglepack.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define NORI_SIMD_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+/* The kernels are compiled for the selected instruction set on a
+   per-function basis, which keeps the remainder of Nori runnable on
+   processors that lack it (the caller checks for support at runtime) */
+#if defined(_MSC_VER)
+#  define NORI_TARGET(isa)
+#else
+#  define NORI_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+#if defined(NORI_SIMD_X86)
+
+/**
+ * \brief Select the closest of the lanes flagged in \c mask
+ *
+ * Ties go to the last lane, which matches the order in which the
+ * scalar code would have reported the intersections
+ */
+static inline int closestLane(uint32_t mask, const float *uu, const float *vv,
+                              const float *tt, float &u, float &v, float &t) {
+    int lane = -1;
+    float closest = std::numeric_limits<float>::infinity();
+    while (mask) {
+        int i = 0;
+        while (!(mask & (1u << i)))
+            ++i;
+        mask &= ~(1u << i);
+        if (tt[i] <= closest) {
+            closest = tt[i];
+            lane = i;
+        }
+    }
+    u = uu[lane]; v = vv[lane]; t = tt[lane];
+    return lane;
+}
+
+#if defined(NORI_SIMD_SSE42)
+
+NORI_TARGET("sse4.2")
+static int intersectPackSSE42(const TrianglePack &pack, const Ray3f &ray,
+                              float &u, float &v, float &t) {
+    const __m128 ox = _mm_set1_ps(ray.o.x()), oy = _mm_set1_ps(ray.o.y()),
+                 oz = _mm_set1_ps(ray.o.z()), dx = _mm_set1_ps(ray.d.x()),
+                 dy = _mm_set1_ps(ray.d.y()), dz = _mm_set1_ps(ray.d.z());
+    const __m128 e1x = _mm_loadu_ps(pack.e1[0]), e1y = _mm_loadu_ps(pack.e1[1]),
+                 e1z = _mm_loadu_ps(pack.e1[2]), e2x = _mm_loadu_ps(pack.e2[0]),
+                 e2y = _mm_loadu_ps(pack.e2[1]), e2z = _mm_loadu_ps(pack.e2[2]);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+    /* Begin calculating determinant - also used to calculate U parameter */
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+    /* If determinant is near zero, ray lies in plane of triangle */
+    __m128 det = _mm_add_ps(_mm_mul_ps(e1x, px),
+        _mm_add_ps(_mm_mul_ps(e1y, py), _mm_mul_ps(e1z, pz)));
+    __m128 mask = _mm_or_ps(_mm_cmple_ps(det, _mm_set1_ps(-1e-8f)),
+                            _mm_cmpge_ps(det, _mm_set1_ps(1e-8f)));
+    __m128 invDet = _mm_div_ps(one, det);
+
+    /* Calculate distance from v[0] to ray origin */
+    __m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(pack.p0[0]));
+    __m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(pack.p0[1]));
+    __m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(pack.p0[2]));
+
+    /* Calculate U parameter and test bounds */
+    __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(tx, px),
+        _mm_add_ps(_mm_mul_ps(ty, py), _mm_mul_ps(tz, pz))), invDet);
+    mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(uu, zero),
+                                       _mm_cmple_ps(uu, one)));
+
+    /* Prepare to test V parameter */
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+    /* Calculate V parameter and test bounds */
+    __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, qx),
+        _mm_add_ps(_mm_mul_ps(dy, qy), _mm_mul_ps(dz, qz))), invDet);
+    mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(vv, zero),
+                                       _mm_cmple_ps(_mm_add_ps(uu, vv), one)));
+
+    /* Ray intersects triangle -> compute t */
+    __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(e2x, qx),
+        _mm_add_ps(_mm_mul_ps(e2y, qy), _mm_mul_ps(e2z, qz))), invDet);
+    mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(tt, _mm_set1_ps(ray.mint)),
+                                       _mm_cmple_ps(tt, _mm_set1_ps(ray.maxt))));
+
+    uint32_t bits = (uint32_t) _mm_movemask_ps(mask);
+    if (!bits)
+        return -1;
+
+    alignas(16) float ua[4], va[4], ta[4];
+    _mm_store_ps(ua, uu); _mm_store_ps(va, vv); _mm_store_ps(ta, tt);
+    return closestLane(bits, ua, va, ta, u, v, t);
+}
+
+#elif defined(NORI_SIMD_AVX2)
+
+NORI_TARGET("avx2")
+static int intersectPackAVX2(const TrianglePack &pack, const Ray3f &ray,
+                             float &u, float &v, float &t) {
+    const __m256 ox = _mm256_set1_ps(ray.o.x()), oy = _mm256_set1_ps(ray.o.y()),
+                 oz = _mm256_set1_ps(ray.o.z()), dx = _mm256_set1_ps(ray.d.x()),
+                 dy = _mm256_set1_ps(ray.d.y()), dz = _mm256_set1_ps(ray.d.z());
+    const __m256 e1x = _mm256_loadu_ps(pack.e1[0]), e1y = _mm256_loadu_ps(pack.e1[1]),
+                 e1z = _mm256_loadu_ps(pack.e1[2]), e2x = _mm256_loadu_ps(pack.e2[0]),
+                 e2y = _mm256_loadu_ps(pack.e2[1]), e2z = _mm256_loadu_ps(pack.e2[2]);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+    /* Begin calculating determinant - also used to calculate U parameter */
+    __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+    /* If determinant is near zero, ray lies in plane of triangle */
+    __m256 det = _mm256_add_ps(_mm256_mul_ps(e1x, px),
+        _mm256_add_ps(_mm256_mul_ps(e1y, py), _mm256_mul_ps(e1z, pz)));
+    __m256 mask = _mm256_or_ps(
+        _mm256_cmp_ps(det, _mm256_set1_ps(-1e-8f), _CMP_LE_OQ),
+        _mm256_cmp_ps(det, _mm256_set1_ps(1e-8f), _CMP_GE_OQ));
+    __m256 invDet = _mm256_div_ps(one, det);
+
+    /* Calculate distance from v[0] to ray origin */
+    __m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(pack.p0[0]));
+    __m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(pack.p0[1]));
+    __m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(pack.p0[2]));
+
+    /* Calculate U parameter and test bounds */
+    __m256 uu = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(tx, px),
+        _mm256_add_ps(_mm256_mul_ps(ty, py), _mm256_mul_ps(tz, pz))), invDet);
+    mask = _mm256_and_ps(mask, _mm256_and_ps(
+        _mm256_cmp_ps(uu, zero, _CMP_GE_OQ), _mm256_cmp_ps(uu, one, _CMP_LE_OQ)));
+
+    /* Prepare to test V parameter */
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+
+    /* Calculate V parameter and test bounds */
+    __m256 vv = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx),
+        _mm256_add_ps(_mm256_mul_ps(dy, qy), _mm256_mul_ps(dz, qz))), invDet);
+    mask = _mm256_and_ps(mask, _mm256_and_ps(
+        _mm256_cmp_ps(vv, zero, _CMP_GE_OQ),
+        _mm256_cmp_ps(_mm256_add_ps(uu, vv), one, _CMP_LE_OQ)));
+
+    /* Ray intersects triangle -> compute t */
+    __m256 tt = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx),
+        _mm256_add_ps(_mm256_mul_ps(e2y, qy), _mm256_mul_ps(e2z, qz))), invDet);
+    mask = _mm256_and_ps(mask, _mm256_and_ps(
+        _mm256_cmp_ps(tt, _mm256_set1_ps(ray.mint), _CMP_GE_OQ),
+        _mm256_cmp_ps(tt, _mm256_set1_ps(ray.maxt), _CMP_LE_OQ)));
+
+    uint32_t bits = (uint32_t) _mm256_movemask_ps(mask);
+    if (!bits)
+        return -1;
+
+    alignas(32) float ua[8], va[8], ta[8];
+    _mm256_store_ps(ua, uu); _mm256_store_ps(va, vv); _mm256_store_ps(ta, tt);
+    return closestLane(bits, ua, va, ta, u, v, t);
+}
+
+#elif defined(NORI_SIMD_AVX512)
+
+NORI_TARGET("avx512f")
+static int intersectPackAVX512(const TrianglePack &pack, const Ray3f &ray,
+                               float &u, float &v, float &t) {
+    const __m512 ox = _mm512_set1_ps(ray.o.x()), oy = _mm512_set1_ps(ray.o.y()),
+                 oz = _mm512_set1_ps(ray.o.z()), dx = _mm512_set1_ps(ray.d.x()),
+                 dy = _mm512_set1_ps(ray.d.y()), dz = _mm512_set1_ps(ray.d.z());
+    const __m512 e1x = _mm512_loadu_ps(pack.e1[0]), e1y = _mm512_loadu_ps(pack.e1[1]),
+                 e1z = _mm512_loadu_ps(pack.e1[2]), e2x = _mm512_loadu_ps(pack.e2[0]),
+                 e2y = _mm512_loadu_ps(pack.e2[1]), e2z = _mm512_loadu_ps(pack.e2[2]);
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+
+    /* Begin calculating determinant - also used to calculate U parameter */
+    __m512 px = _mm512_sub_ps(_mm512_mul_ps(dy, e2z), _mm512_mul_ps(dz, e2y));
+    __m512 py = _mm512_sub_ps(_mm512_mul_ps(dz, e2x), _mm512_mul_ps(dx, e2z));
+    __m512 pz = _mm512_sub_ps(_mm512_mul_ps(dx, e2y), _mm512_mul_ps(dy, e2x));
+
+    /* If determinant is near zero, ray lies in plane of triangle */
+    __m512 det = _mm512_add_ps(_mm512_mul_ps(e1x, px),
+        _mm512_add_ps(_mm512_mul_ps(e1y, py), _mm512_mul_ps(e1z, pz)));
+    __mmask16 mask =
+        _mm512_cmp_ps_mask(det, _mm512_set1_ps(-1e-8f), _CMP_LE_OQ) |
+        _mm512_cmp_ps_mask(det, _mm512_set1_ps(1e-8f), _CMP_GE_OQ);
+    if (!mask)
+        return -1;
+    __m512 invDet = _mm512_div_ps(one, det);
+
+    /* Calculate distance from v[0] to ray origin */
+    __m512 tx = _mm512_sub_ps(ox, _mm512_loadu_ps(pack.p0[0]));
+    __m512 ty = _mm512_sub_ps(oy, _mm512_loadu_ps(pack.p0[1]));
+    __m512 tz = _mm512_sub_ps(oz, _mm512_loadu_ps(pack.p0[2]));
+
+    /* Calculate U parameter and test bounds */
+    __m512 uu = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(tx, px),
+        _mm512_add_ps(_mm512_mul_ps(ty, py), _mm512_mul_ps(tz, pz))), invDet);
+    mask = _mm512_mask_cmp_ps_mask(mask, uu, zero, _CMP_GE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, uu, one, _CMP_LE_OQ);
+
+    /* Prepare to test V parameter */
+    __m512 qx = _mm512_sub_ps(_mm512_mul_ps(ty, e1z), _mm512_mul_ps(tz, e1y));
+    __m512 qy = _mm512_sub_ps(_mm512_mul_ps(tz, e1x), _mm512_mul_ps(tx, e1z));
+    __m512 qz = _mm512_sub_ps(_mm512_mul_ps(tx, e1y), _mm512_mul_ps(ty, e1x));
+
+    /* Calculate V parameter and test bounds */
+    __m512 vv = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(dx, qx),
+        _mm512_add_ps(_mm512_mul_ps(dy, qy), _mm512_mul_ps(dz, qz))), invDet);
+    mask = _mm512_mask_cmp_ps_mask(mask, vv, zero, _CMP_GE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, _mm512_add_ps(uu, vv), one, _CMP_LE_OQ);
+
+    /* Ray intersects triangle -> compute t */
+    __m512 tt = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx),
+        _mm512_add_ps(_mm512_mul_ps(e2y, qy), _mm512_mul_ps(e2z, qz))), invDet);
+    mask = _mm512_mask_cmp_ps_mask(mask, tt, _mm512_set1_ps(ray.mint), _CMP_GE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, tt, _mm512_set1_ps(ray.maxt), _CMP_LE_OQ);
+
+    if (!mask)
+        return -1;
+
+    alignas(64) float ua[16], va[16], ta[16];
+    _mm512_store_ps(ua, uu); _mm512_store_ps(va, vv); _mm512_store_ps(ta, tt);
+    return closestLane((uint32_t) mask, ua, va, ta, u, v, t);
+}
+
+#endif
+
+#if defined(_MSC_VER)
+/// Query CPUID and the OS-enabled register state (MSVC)
+static bool cpuSupports(const char *isa) {
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse42 = (info[2] & (1 << 20)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (strcmp(isa, "sse4.2") == 0)
+        return sse42;
+    if (!osxsave || maxLeaf < 7)
+        return false;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (strcmp(isa, "avx2") == 0)
+        return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+    if (strcmp(isa, "avx512f") == 0)
+        return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+    return false;
+}
+#define NORI_CPU_SUPPORTS(isa) cpuSupports(isa)
+#else
+#define NORI_CPU_SUPPORTS(isa) __builtin_cpu_supports(isa)
+#endif
+
+#endif /* NORI_SIMD_X86 */
+
+TrianglePackIntersector getTrianglePackIntersector(std::string &name) {
+#if defined(NORI_SIMD_X86) && defined(NORI_SIMD_SSE42)
+    name = "SSE4.2";
+    if (NORI_CPU_SUPPORTS("sse4.2"))
+        return intersectPackSSE42;
+#elif defined(NORI_SIMD_X86) && defined(NORI_SIMD_AVX2)
+    name = "AVX2";
+    if (NORI_CPU_SUPPORTS("avx2"))
+        return intersectPackAVX2;
+#elif defined(NORI_SIMD_X86) && defined(NORI_SIMD_AVX512)
+    name = "AVX-512";
+    if (NORI_CPU_SUPPORTS("avx512f"))
+        return intersectPackAVX512;
+#else
+    name = "none";
+#endif
+    return nullptr;
+}
+
+NORI_NAMESPACE_END
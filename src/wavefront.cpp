@@ -0,0 +1,591 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/sampler.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+#include <nori/block.h>
+#include <nori/packet.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Queue of rays in structure-of-arrays layout
+ *
+ * Every ray belongs to the path with index \c path. Shadow rays
+ * additionally carry the contribution that is added to the radiance
+ * estimate of their path if the ray segment turns out to be unoccluded.
+ */
+struct RayQueue {
+    std::vector<float> o[3];          ///< Ray origins (one array per dimension)
+    std::vector<float> d[3];          ///< Ray directions (one array per dimension)
+    std::vector<float> maxt;          ///< Maximum positions on the ray segments
+    std::vector<float> time;          ///< Times within the shutter interval
+    std::vector<Color3f> weight;      ///< Contribution of unoccluded shadow rays
+    std::vector<uint32_t> path;       ///< Index of the path that owns the ray
+
+    size_t size() const { return path.size(); }
+
+    void clear() {
+        for (int k=0; k<3; ++k) {
+            o[k].clear(); d[k].clear();
+        }
+        maxt.clear(); time.clear(); weight.clear(); path.clear();
+    }
+
+    void push(const Ray3f &ray, uint32_t index, const Color3f &w = Color3f(0.0f)) {
+        for (int k=0; k<3; ++k) {
+            o[k].push_back(ray.o[k]);
+            d[k].push_back(ray.d[k]);
+        }
+        maxt.push_back(ray.maxt);
+        time.push_back(ray.time);
+        weight.push_back(w);
+        path.push_back(index);
+    }
+
+    void swap(RayQueue &queue) {
+        for (int k=0; k<3; ++k) {
+            o[k].swap(queue.o[k]); d[k].swap(queue.d[k]);
+        }
+        maxt.swap(queue.maxt); time.swap(queue.time);
+        weight.swap(queue.weight); path.swap(queue.path);
+    }
+
+    Point3f getOrigin(uint32_t i) const { return Point3f(o[0][i], o[1][i], o[2][i]); }
+    Vector3f getDirection(uint32_t i) const { return Vector3f(d[0][i], d[1][i], d[2][i]); }
+
+    Ray3f getRay(uint32_t i) const {
+        Ray3f ray(getOrigin(i), getDirection(i), Epsilon, maxt[i]);
+        ray.time = time[i];
+        return ray;
+    }
+
+    /**
+     * \brief Rearrange the queue so that entry \c i becomes the former
+     * entry \c perm[i]
+     *
+     * The \c tmp arguments are scratch buffers that are swapped with the
+     * queue's arrays, so that no memory is allocated once they are large
+     * enough.
+     */
+    void reorder(const std::vector<uint32_t> &perm, std::vector<float> &tmp,
+                 std::vector<Color3f> &tmpWeight, std::vector<uint32_t> &tmpPath) {
+        for (int k=0; k<3; ++k) {
+            gather(o[k], perm, tmp); gather(d[k], perm, tmp);
+        }
+        gather(maxt, perm, tmp); gather(time, perm, tmp);
+        gather(weight, perm, tmpWeight);
+        gather(path, perm, tmpPath);
+    }
+
+private:
+    template <typename T>
+    static void gather(std::vector<T> &v, const std::vector<uint32_t> &perm, std::vector<T> &tmp) {
+        tmp.resize(v.size());
+        for (size_t i=0; i<perm.size(); ++i)
+            tmp[i] = v[perm[i]];
+        v.swap(tmp);
+    }
+};
+
+/**
+ * \brief State of all paths that are traced together
+ *
+ * Per-path quantities are indexed by path, the ray queues refer to
+ * paths through \ref RayQueue::path.
+ */
+struct Wave {
+    std::vector<Point2f> pixelSample;  ///< Image plane position of the camera sample
+    std::vector<Color3f> cameraWeight; ///< Importance weight of the camera ray
+    std::vector<Color3f> radiance;     ///< Radiance estimate accumulated so far
+    std::vector<Color3f> throughput;   ///< Path throughput (including Russian roulette)
+    /// Solid angle density of the last BSDF sample (negative: no MIS)
+    std::vector<float> bsdfPdf;
+    std::vector<Intersection> its;     ///< Closest hit of the path's current ray
+
+    RayQueue rays;                     ///< Rays of the current bounce
+    RayQueue nextRays;                 ///< Continuation rays of the next bounce
+    RayQueue shadowRays;               ///< Shadow rays of the current bounce
+    std::vector<uint32_t> hits;        ///< Queue entries whose ray hit a surface
+
+    /* Scratch space of the sorting and bucketing steps */
+    std::vector<uint64_t> keys, keys2;
+    std::vector<uint32_t> perm;
+    std::vector<float> tmp;
+    std::vector<Color3f> tmpWeight;
+    std::vector<uint32_t> tmpPath;
+    std::vector<const BSDF *> bsdfs;
+    std::vector<uint32_t> bucket, bucketOffset;
+
+    /* Per-hit scratch space of the shading stage */
+    std::vector<EmitterQueryRecord> eRecs;
+    std::vector<BSDFQueryRecord> bRecs;
+    std::vector<Point2f> samples;
+    std::vector<Color3f> emission, values;
+    std::vector<float> lightPdf, pdfs;
+    std::vector<uint32_t> alive;
+
+    /// Start a new wave of \c count paths without camera rays
+    void reset(size_t count) {
+        pixelSample.resize(count);
+        cameraWeight.resize(count);
+        radiance.assign(count, Color3f(0.0f));
+        throughput.assign(count, Color3f(1.0f));
+        bsdfPdf.assign(count, -1.0f);
+        its.resize(count);
+        rays.clear();
+        nextRays.clear();
+        shadowRays.clear();
+    }
+};
+
+/**
+ * \brief Wavefront path tracer with multiple importance sampling
+ *
+ * This integrator computes the same estimator as \c path_mis, but
+ * instead of following one camera sample at a time, it advances a large
+ * number of paths (a \a wave) by one bounce per iteration. Each bounce
+ * is split into stages that operate on queues of rays in
+ * structure-of-arrays layout:
+ *
+ * 1. generate: camera rays for all pixel samples of the wave
+ * 2. extend: closest-hit queries for all rays of the current bounce
+ * 3. shade: emission, next event estimation, Russian roulette and
+ *    BSDF sampling. The hit points are grouped by BSDF first, and each
+ *    group is shaded using the batched BSDF interface (see
+ *    \ref BSDF::sampleBatch()), so that each material's code runs over a
+ *    contiguous batch without per-hit virtual calls.
+ * 4. shadow: any-hit queries for the shadow rays generated by (3)
+ * 5. accumulate: splat the finished paths into the image block
+ *
+ * Before tracing, the rays of a queue are sorted by direction octant and
+ * by the Morton code of their origin. Neighboring rays then visit similar
+ * parts of the BVH, and can be traced in packets of 8.
+ *
+ * The following (optional) properties are supported:
+ *
+ * <tt>waveSize</tt>: number of paths traced together (default: 16384)
+ *
+ * <tt>sortRays</tt>: sort the ray queues for coherence (default: true)
+ *
+ * <tt>packets</tt>: trace the queues using ray packets instead of one
+ * ray at a time (default: false). This only pays off for coherent
+ * rays, e.g. in scenes with mostly specular surfaces.
+ *
+ * Random numbers are consumed in a different order than by \c path_mis,
+ * so the two integrators produce different (but equally distributed)
+ * noise.
+ */
+class WavefrontIntegrator : public Integrator {
+public:
+    enum {
+        PacketSize = 8
+    };
+
+    typedef TRayPacket<PacketSize> RayPacket;
+    typedef TIntersectionPacket<PacketSize> IntersectionPacket;
+
+    WavefrontIntegrator(const PropertyList &propList) {
+        m_waveSize = propList.getInteger("waveSize", 16384);
+        m_sortRays = propList.getBoolean("sortRays", true);
+        m_packets = propList.getBoolean("packets", false);
+        if (m_waveSize <= 0)
+            throw NoriException("WavefrontIntegrator: waveSize must be positive!");
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        /* Trace a wave consisting of a single path */
+        Wave wave;
+        wave.reset(1);
+        wave.rays.push(ray, 0);
+        trace(scene, sampler, wave);
+        return wave.radiance[0];
+    }
+
+    void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) const {
+        const Camera *camera = scene->getCamera();
+
+        Point2i offset = block.getOffset();
+        Vector2i size  = block.getSize();
+        int pixelCount = size.x() * size.y();
+
+        /* Count the samples of all pixels (which may differ when
+           sampling adaptively) */
+        size_t total = 0;
+        for (int pixel = 0; pixel < pixelCount; ++pixel)
+            total += sampler->getPixelSampleCount(
+                offset + Vector2i(pixel % size.x(), pixel / size.x()));
+
+        /* Clear the block contents */
+        block.clear();
+
+        /* Pixel and sample within the pixel that the next wave starts at */
+        int pixel = -1, x = 0, y = 0;
+        size_t sample = 0, sampleCount = 0;
+
+        /* Each thread reuses its wave, so that the queues and scratch
+           buffers stop allocating memory once they have grown to size */
+        Wave &wave = m_waves.local();
+        for (size_t start = 0; start < total; start += (size_t) m_waveSize) {
+            size_t count = std::min(total - start, (size_t) m_waveSize);
+            wave.reset(count);
+
+            /* Stage 1: generate camera rays */
+            for (size_t i = 0; i < count; ++i) {
+                /* Advance to the next pixel that has samples left */
+                while (sample == sampleCount) {
+                    ++pixel;
+                    x = pixel % size.x();
+                    y = pixel / size.x();
+                    sample = 0;
+                    sampleCount = sampler->getPixelSampleCount(offset + Vector2i(x, y));
+                }
+                ++sample;
+
+                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                Ray3f ray;
+                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+                /* Sample a time within the shutter interval */
+                if (scene->hasMotion())
+                    ray.time = sampler->next1D();
+
+                wave.pixelSample[i] = pixelSample;
+                wave.cameraWeight[i] = value;
+                if (!value.isZero())
+                    wave.rays.push(ray, (uint32_t) i);
+            }
+
+            /* Stages 2-4 for all bounces */
+            trace(scene, sampler, wave);
+
+            /* Stage 5: accumulate */
+            for (size_t i = 0; i < count; ++i)
+                wave.radiance[i] *= wave.cameraWeight[i];
+            block.put(wave.pixelSample.data(), wave.radiance.data(), count);
+        }
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "WavefrontIntegrator[\n"
+            "  waveSize = %i,\n"
+            "  sortRays = %s,\n"
+            "  packets = %s\n"
+            "]",
+            m_waveSize,
+            m_sortRays ? "yes" : "no",
+            m_packets ? "yes" : "no"
+        );
+    }
+
+protected:
+    /// Advance all paths of the wave until they have terminated
+    void trace(const Scene *scene, Sampler *sampler, Wave &wave) const {
+        int depth = 1;
+        while (wave.rays.size() > 0) {
+            if (m_sortRays)
+                sortRays(scene, wave.rays, wave);
+            extend(scene, wave);
+            shade(scene, sampler, wave, depth);
+            if (m_sortRays)
+                sortRays(scene, wave.shadowRays, wave);
+            shadow(scene, wave);
+
+            wave.rays.swap(wave.nextRays);
+            wave.nextRays.clear();
+            wave.shadowRays.clear();
+            ++depth;
+        }
+    }
+
+    /// Spread the lower 9 bits of \c v so that there are two zero bits between each
+    static uint32_t expandBits(uint32_t v) {
+        v = (v | (v << 16)) & 0x030000FFu;
+        v = (v | (v <<  8)) & 0x0300F00Fu;
+        v = (v | (v <<  4)) & 0x030C30C3u;
+        v = (v | (v <<  2)) & 0x09249249u;
+        return v;
+    }
+
+    /**
+     * \brief Sort a ray queue by direction octant and origin
+     *
+     * The key consists of the three direction sign bits, followed by a
+     * 27-bit Morton code of the ray origin within the scene's bounding box.
+     */
+    void sortRays(const Scene *scene, RayQueue &queue, Wave &wave) const {
+        size_t n = queue.size();
+        if (n <= PacketSize)
+            return;
+
+        const BoundingBox3f &bbox = scene->getBoundingBox();
+        Vector3f scale = Vector3f(511.0f).cwiseQuotient(
+            bbox.getExtents().cwiseMax(Vector3f(Epsilon)));
+
+        wave.keys.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t key = 0;
+            for (int k = 0; k < 3; ++k) {
+                float rel = (queue.o[k][i] - bbox.min[k]) * scale[k];
+                uint32_t cell = (uint32_t) std::min(std::max(rel, 0.0f), 511.0f);
+                key |= expandBits(cell) << (2 - k);
+                key |= (queue.d[k][i] < 0 ? 1u : 0u) << (27 + k);
+            }
+            wave.keys[i] = ((uint64_t) key << 32) | (uint64_t) i;
+        }
+
+        /* LSD radix sort of the 30-bit keys (3 passes with 10 bits each) */
+        wave.keys2.resize(n);
+        for (int shift = 32; shift < 62; shift += 10) {
+            uint32_t offset[1025] = { 0 };
+            for (size_t i = 0; i < n; ++i)
+                offset[((wave.keys[i] >> shift) & 1023) + 1]++;
+            for (int b = 0; b < 1024; ++b)
+                offset[b + 1] += offset[b];
+            for (size_t i = 0; i < n; ++i)
+                wave.keys2[offset[(wave.keys[i] >> shift) & 1023]++] = wave.keys[i];
+            wave.keys.swap(wave.keys2);
+        }
+
+        wave.perm.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            wave.perm[i] = (uint32_t) wave.keys[i];
+        queue.reorder(wave.perm, wave.tmp, wave.tmpWeight, wave.tmpPath);
+    }
+
+    /// Stage 2: find the closest hit of every ray in the queue
+    void extend(const Scene *scene, Wave &wave) const {
+        const RayQueue &rays = wave.rays;
+        size_t n = rays.size();
+        wave.hits.clear();
+
+        if (!m_packets) {
+            for (size_t i = 0; i < n; ++i) {
+                if (scene->rayIntersect(rays.getRay((uint32_t) i), wave.its[rays.path[i]]))
+                    wave.hits.push_back((uint32_t) i);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < n; i += PacketSize) {
+            RayPacket packet;
+            IntersectionPacket its;
+            int lanes = (int) std::min(n - i, (size_t) PacketSize);
+            for (int k = 0; k < lanes; ++k)
+                packet.setRay(k, rays.getRay((uint32_t) (i + k)));
+
+            if (!scene->rayIntersect(packet, its))
+                continue;
+
+            for (int k = 0; k < lanes; ++k) {
+                if (!its.valid[k])
+                    continue;
+                wave.its[rays.path[i + k]] = its[k];
+                wave.hits.push_back((uint32_t) (i + k));
+            }
+        }
+    }
+
+    /**
+     * \brief Stage 3: shade all hit points
+     *
+     * The hits are first grouped by BSDF using a counting sort, which
+     * keeps the order of the (sorted) rays within each group.
+     */
+    void shade(const Scene *scene, Sampler *sampler, Wave &wave, int depth) const {
+        const RayQueue &rays = wave.rays;
+        size_t n = wave.hits.size();
+
+        /* Assign a bucket to each distinct BSDF */
+        wave.bsdfs.clear();
+        wave.bucket.resize(n);
+        size_t last = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const BSDF *bsdf = wave.its[rays.path[wave.hits[i]]].mesh->getBSDF();
+            if (last >= wave.bsdfs.size() || wave.bsdfs[last] != bsdf) {
+                last = std::find(wave.bsdfs.begin(), wave.bsdfs.end(), bsdf) - wave.bsdfs.begin();
+                if (last == wave.bsdfs.size())
+                    wave.bsdfs.push_back(bsdf);
+            }
+            wave.bucket[i] = (uint32_t) last;
+        }
+
+        wave.samples.resize(n);
+        wave.emission.resize(n);
+        wave.values.resize(n);
+        wave.lightPdf.resize(n);
+        wave.pdfs.resize(n);
+
+        size_t bucketCount = wave.bsdfs.size();
+        wave.bucketOffset.assign(bucketCount + 1, 0);
+        for (size_t i = 0; i < n; ++i)
+            wave.bucketOffset[wave.bucket[i] + 1]++;
+        for (size_t b = 0; b < bucketCount; ++b)
+            wave.bucketOffset[b + 1] += wave.bucketOffset[b];
+
+        wave.perm.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            wave.perm[wave.bucketOffset[wave.bucket[i]]++] = wave.hits[i];
+
+        /* Process one BSDF at a time (offsets now point to the bucket ends) */
+        size_t begin = 0;
+        for (size_t b = 0; b < bucketCount; ++b) {
+            size_t end = wave.bucketOffset[b];
+            shadeBucket(scene, sampler, wave, wave.bsdfs[b],
+                        wave.perm.data() + begin, end - begin, depth);
+            begin = end;
+        }
+    }
+
+    /**
+     * \brief Shade a group of hit points that share the same BSDF
+     *
+     * The BSDF is queried through its batched interface in two passes
+     * (light sampling, then BSDF sampling), so that the whole group is
+     * shaded with a few virtual calls instead of three per hit point.
+     */
+    void shadeBucket(const Scene *scene, Sampler *sampler, Wave &wave, const BSDF *bsdf,
+                     const uint32_t *entries, size_t count, int depth) const {
+        const RayQueue &rays = wave.rays;
+        float sampleEmitterPdf = scene->sampleEmitterPdf();
+
+        /* Pass 1: emission and light sampling */
+        wave.eRecs.clear();
+        wave.bRecs.clear();
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t entry = entries[i], path = rays.path[entry];
+            const Intersection &its = wave.its[path];
+            Vector3f wi = its.toLocal(-rays.getDirection(entry));
+
+            /* Emission, weighted against the light sampling strategy */
+            if (its.mesh->isEmitter()) {
+                const Emitter *emitter = its.mesh->getEmitter();
+                EmitterQueryRecord eRec(rays.getOrigin(entry), its.p, its.shFrame.n);
+                float w_mats = 1.0f, pdf_mats = wave.bsdfPdf[path];
+                if (pdf_mats >= 0.0f) {
+                    float pdf_ems = emitter->pdf(eRec);
+                    w_mats = pdf_mats;
+                    if (pdf_ems + pdf_mats > 0.0f)
+                        w_mats = pdf_mats / (pdf_ems + pdf_mats);
+                }
+                wave.radiance[path] += wave.throughput[path] * w_mats * emitter->eval(eRec);
+            }
+
+            /* Sample a point on a light source */
+            Emitter *emitter = scene->sampleEmitter(sampler);
+            wave.eRecs.emplace_back(its.p);
+            EmitterQueryRecord &eRec = wave.eRecs.back();
+            wave.emission[i] = emitter->sample(eRec, sampler);
+            wave.lightPdf[i] = emitter->pdf(eRec);
+            wave.bRecs.emplace_back(wi, its.toLocal(-eRec.wi), ESolidAngle);
+        }
+
+        /* Pass 2: evaluate the BSDF towards the light samples */
+        bsdf->evalBatch(count, wave.bRecs.data(), wave.values.data());
+        bsdf->pdfBatch(count, wave.bRecs.data(), wave.pdfs.data());
+
+        /* Pass 3: queue shadow rays and apply Russian roulette */
+        wave.alive.clear();
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t entry = entries[i], path = rays.path[entry];
+            Color3f &t = wave.throughput[path];
+
+            if (!wave.emission[i].isZero()) {
+                float pdf_ems = wave.lightPdf[i], pdf_mats = wave.pdfs[i];
+                float w_ems = pdf_ems;
+                if (pdf_ems + pdf_mats > 0.0f)
+                    w_ems = pdf_ems / (pdf_ems + pdf_mats);
+                Color3f value = wave.emission[i] * wave.values[i]
+                    * std::abs(Frame::cosTheta(wave.bRecs[i].wo))
+                    * t * w_ems / sampleEmitterPdf;
+                if (!value.isZero()) {
+                    Ray3f &shadowRay = wave.eRecs[i].shadowRay;
+                    shadowRay.time = rays.time[entry];
+                    wave.shadowRays.push(shadowRay, path, value);
+                }
+            }
+
+            if (depth >= 3) {
+                float p = std::min(t.maxCoeff(), 0.99f);
+                if (sampler->next1D() > p)
+                    continue;
+                t /= p;
+            }
+            wave.alive.push_back((uint32_t) i);
+        }
+
+        /* Pass 4: sample the BSDF for the surviving paths */
+        size_t alive = wave.alive.size();
+        for (size_t j = 0; j < alive; ++j) {
+            wave.bRecs[j] = BSDFQueryRecord(wave.bRecs[wave.alive[j]].wi);
+            wave.samples[j] = sampler->next2D();
+        }
+        bsdf->sampleBatch(alive, wave.bRecs.data(), wave.samples.data(), wave.values.data());
+        bsdf->pdfBatch(alive, wave.bRecs.data(), wave.pdfs.data());
+
+        /* Pass 5: queue the continuation rays */
+        for (size_t j = 0; j < alive; ++j) {
+            uint32_t entry = entries[wave.alive[j]], path = rays.path[entry];
+            const Intersection &its = wave.its[path];
+            const BSDFQueryRecord &bRec = wave.bRecs[j];
+            Color3f &t = wave.throughput[path];
+
+            t *= wave.values[j];
+            if (t.isZero())
+                continue;
+            wave.bsdfPdf[path] = bRec.measure == EDiscrete ? -1.0f : wave.pdfs[j];
+
+            Ray3f ray(its.p, its.toWorld(bRec.wo));
+            ray.time = rays.time[entry];
+            wave.nextRays.push(ray, path);
+        }
+    }
+
+    /// Stage 4: add the contributions of all unoccluded shadow rays
+    void shadow(const Scene *scene, Wave &wave) const {
+        const RayQueue &rays = wave.shadowRays;
+        size_t n = rays.size();
+
+        if (!m_packets) {
+            for (size_t i = 0; i < n; ++i) {
+                if (!scene->rayIntersect(rays.getRay((uint32_t) i)))
+                    wave.radiance[rays.path[i]] += rays.weight[i];
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < n; i += PacketSize) {
+            RayPacket packet;
+            int lanes = (int) std::min(n - i, (size_t) PacketSize);
+            for (int k = 0; k < lanes; ++k)
+                packet.setRay(k, rays.getRay((uint32_t) (i + k)));
+
+            RayPacket::MaskPacket occluded = scene->rayIntersect(packet);
+            for (int k = 0; k < lanes; ++k) {
+                if (!occluded[k])
+                    wave.radiance[rays.path[i + k]] += rays.weight[i + k];
+            }
+        }
+    }
+
+private:
+    int m_waveSize;
+    bool m_sortRays;
+    bool m_packets;
+    mutable tbb::enumerable_thread_specific<Wave> m_waves;
+};
+
+NORI_REGISTER_CLASS(WavefrontIntegrator, "wavefront");
+NORI_NAMESPACE_END
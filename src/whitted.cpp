@@ -26,6 +26,7 @@ public:
             float sampleEmitterPdf = scene->sampleEmitterPdf();
             EmitterQueryRecord eRec(its.p);
             Color3f emission = emitter->sample(eRec, sampler);
+            eRec.shadowRay.time = ray.time;
             if (scene->rayIntersect(eRec.shadowRay)) {
                 emission = 0.0f;
             }
@@ -39,7 +40,9 @@ public:
             BSDFQueryRecord bRec(its.toLocal(-ray.d));
             Color3f color = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
             if (sampler->next1D() < 0.95f && color.x() > 0.0f) {
-                return color * Li(scene, sampler, Ray3f(its.p, its.toWorld(bRec.wo))) / 0.95f;
+                Ray3f r(its.p, its.toWorld(bRec.wo));
+                r.time = ray.time;
+                return color * Li(scene, sampler, r) / 0.95f;
             }
             else return Color3f(0.0f);
         }